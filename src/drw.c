@@ -198,20 +198,38 @@ void drw_fontset_free(Fnt* font)
 	}
 }
 
+int drw_clr_alloc(Drw* drw, Clr* dest, const char* clrname)
+{
+	if (! drw || ! dest || ! clrname)
+		return 0;
+
+	return XftColorAllocName(
+		drw->dpy,
+		DefaultVisual(drw->dpy, drw->screen),
+		DefaultColormap(drw->dpy, drw->screen),
+		clrname,
+		dest);
+}
+
 void drw_clr_create(Drw* drw, Clr* dest, const char* clrname)
 {
 	if (! drw || ! dest || ! clrname)
 		return;
 
-	if (! XftColorAllocName(
-				drw->dpy,
-				DefaultVisual(drw->dpy, drw->screen),
-				DefaultColormap(drw->dpy, drw->screen),
-				clrname,
-				dest))
+	if (! drw_clr_alloc(drw, dest, clrname))
 		die("error, cannot allocate color '%s'", clrname);
 }
 
+void drw_clr_free(Drw* drw, Clr* c)
+{
+	if (drw && c)
+		XftColorFree(
+			drw->dpy,
+			DefaultVisual(drw->dpy, drw->screen),
+			DefaultColormap(drw->dpy, drw->screen),
+			c);
+}
+
 /* Wrapper to create color schemes. The caller has to call free(3) on the
  * returned color scheme when done using it. */
 Clr* drw_scm_create(Drw* drw, const char* clrnames[], size_t clrcount)
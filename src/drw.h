@@ -55,7 +55,9 @@ void drw_font_getexts(
 	unsigned int* h);
 
 /* Colorscheme abstraction */
+int  drw_clr_alloc(Drw* drw, Clr* dest, const char* clrname); /* 0 on failure */
 void drw_clr_create(Drw* drw, Clr* dest, const char* clrname);
+void drw_clr_free(Drw* drw, Clr* c);
 Clr* drw_scm_create(Drw* drw, const char* clrnames[], size_t clrcount);
 
 /* Cursor abstraction */
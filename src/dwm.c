@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <signal.h>
@@ -7,6 +8,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
@@ -22,12 +28,113 @@
 #include "util.h"
 
 // function implementations {{{
+void
+applybatch(BatchOp *o)
+{
+	Client *c = o->c;
+	Monitor *m = o->m;
+
+	if (c)
+		o->from = c->mon;
+	switch (o->op) {
+	case BatchTag:
+		c->tags = o->arg.ui & TAGMASK;
+		break;
+	case BatchMonitor:
+		if (c->mon == m)
+			break;
+		if (c == selmon->sel)
+			unfocus(c, 1);
+		detach(c);
+		detachstack(c);
+		c->mon = m;
+		c->tags = m->tagset[m->seltags];
+		attachabove(c);
+		attachstack(c);
+		break;
+	case BatchFloat:
+		if (c->isfloating == (o->arg.i || c->isfixed))
+			break;
+		c->isfloating = !c->isfloating;
+		if (c->isfloating)
+			resize(c, c->sfx, c->sfy, c->sfw, c->sfh, False);
+		else {
+			c->sfx = c->x;
+			c->sfy = c->y;
+			c->sfw = c->w;
+			c->sfh = c->h;
+		}
+		break;
+	case BatchResize:
+		/* tiled clients keep it for when they float */
+		c->sfx = o->x;
+		c->sfy = o->y;
+		c->sfw = o->w;
+		c->sfh = o->h;
+		if (c->isfloating)
+			resize(c, o->x, o->y, o->w, o->h, False);
+		break;
+	case BatchLayout:
+		m->lt[m->sellt] = o->arg.v;
+		break;
+	case BatchMfact:
+		m->mfact = o->arg.f;
+		break;
+	case BatchNmaster:
+		m->nmaster = o->arg.i;
+		break;
+	case BatchView:
+		if ((o->arg.ui & TAGMASK) == m->tagset[m->seltags])
+			break;
+		m->seltags ^= 1;
+		m->tagset[m->seltags] = o->arg.ui & TAGMASK;
+		break;
+	}
+}
+
+/* adjusts w and h to the aspect, increments, minimum and maximum in s */
+void
+applyhints(const SizeHints *s, int *w, int *h)
+{
+	int baseismin;
+
+	/* see last two sentences in ICCCM 4.1.2.3 */
+	baseismin = s->basew == s->minw && s->baseh == s->minh;
+	if (!baseismin) { /* temporarily remove base dimensions */
+		*w -= s->basew;
+		*h -= s->baseh;
+	}
+	/* adjust for aspect limits */
+	if (s->mina > 0 && s->maxa > 0) {
+		if (s->maxa < (float)*w / *h)
+			*w = *h * s->maxa + 0.5;
+		else if (s->mina < (float)*h / *w)
+			*h = *w * s->mina + 0.5;
+	}
+	if (baseismin) { /* increment calculation requires this */
+		*w -= s->basew;
+		*h -= s->baseh;
+	}
+	/* adjust for increment value */
+	if (s->incw)
+		*w -= *w % s->incw;
+	if (s->inch)
+		*h -= *h % s->inch;
+	/* restore base dimensions */
+	*w = MAX(*w + s->basew, s->minw);
+	*h = MAX(*h + s->baseh, s->minh);
+	if (s->maxw)
+		*w = MIN(*w, s->maxw);
+	if (s->maxh)
+		*h = MIN(*h, s->maxh);
+}
+
 void
 applyrules(Client *c)
 {
-	const char *class, *instance;
-	unsigned int i;
-	const Rule *r;
+	const char *class, *instance, *fields[RuleLast];
+	int i;
+	const RuleRec *r;
 	Monitor *m;
 	XClassHint ch = { NULL, NULL };
 
@@ -39,29 +146,28 @@ applyrules(Client *c)
 	class    = ch.res_class ? ch.res_class : broken;
 	instance = ch.res_name  ? ch.res_name  : broken;
 
-	for (i = 0; i < LENGTH(rules); i++) {
-		r = &rules[i];
-		if ((!r->title || strstr(c->name, r->title))
-		&& (!r->class || strstr(class, r->class))
-		&& (!r->instance || strstr(instance, r->instance)))
-		{
-			c->isfloating = r->isfloating;
-			c->tags |= r->tags;
-			c->scratchkey = r->scratchkey;
-			if (r->floatborderpx >= 0) {
-				c->floatborderpx = r->floatborderpx;
-				c->hasfloatbw = 1;
-			}
-			if (r->isfloating) {
-				if (r->floatx >= 0) c->x = c->mon->mx + r->floatx;
-				if (r->floaty >= 0) c->y = c->mon->my + r->floaty;
-				if (r->floatw >= 0) c->w = r->floatw;
-				if (r->floath >= 0) c->h = r->floath;
-			}
-			for (m = mons; m && m->num != r->monitor; m = m->next);
-			if (m)
-				c->mon = m;
+	fields[RuleClass]    = class;
+	fields[RuleInstance] = instance;
+	fields[RuleTitle]    = c->info->name;
+	ri_match(ruleindex, fields);
+	for (i = -1; (i = ri_next(ruleindex, i)) >= 0;) {
+		r = &ruleindex->rec[i];
+		c->isfloating = r->isfloating;
+		c->tags |= r->tags;
+		c->scratchkey = r->scratchkey;
+		if (r->floatborderpx >= 0) {
+			c->floatborderpx = r->floatborderpx;
+			c->hasfloatbw = 1;
 		}
+		if (r->isfloating) {
+			if (r->floatx >= 0) c->x = c->mon->mx + r->floatx;
+			if (r->floaty >= 0) c->y = c->mon->my + r->floaty;
+			if (r->floatw >= 0) c->w = r->floatw;
+			if (r->floath >= 0) c->h = r->floath;
+		}
+		for (m = mons; m && m->num != r->monitor; m = m->next);
+		if (m)
+			c->mon = m;
 	}
 	if (ch.res_class)
 		XFree(ch.res_class);
@@ -70,10 +176,65 @@ applyrules(Client *c)
 	c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
 }
 
+void
+applystate(void)
+{
+	Client *c, **tc, **v;
+	const ClientState **cs, *t;
+	Monitor *m;
+	uint32_t i, j, n;
+
+	if (!restoring)
+		return;
+	/* put the saved clients of each monitor back in their client list and
+	 * focus stack order, behind any the previous instance did not know */
+	v = ecalloc(restoring->nclients + 1, sizeof(Client *));
+	cs = ecalloc(restoring->nclients + 1, sizeof(ClientState *));
+	for (m = mons; m; m = m->next) {
+		for (i = n = 0; i < restoring->nclients; i++)
+			if ((c = wintoclient(restoring->clients[i].win)) && c->mon == m) {
+				cs[n] = &restoring->clients[i];
+				v[n++] = c;
+			}
+		for (i = 0; i < n; i++) {
+			detach(v[i]);
+			detachstack(v[i]);
+		}
+		for (i = 1; i < n; i++)
+			for (j = i; j > 0 && cs[j - 1]->pos > cs[j]->pos; j--) {
+				t = cs[j], cs[j] = cs[j - 1], cs[j - 1] = t;
+				c = v[j], v[j] = v[j - 1], v[j - 1] = c;
+			}
+		for (tc = &m->clients; *tc; tc = &(*tc)->next);
+		for (i = 0; i < n; tc = &v[i++]->next)
+			*tc = v[i];
+		*tc = NULL;
+		for (i = 1; i < n; i++)
+			for (j = i; j > 0 && cs[j - 1]->stack > cs[j]->stack; j--) {
+				t = cs[j], cs[j] = cs[j - 1], cs[j - 1] = t;
+				c = v[j], v[j] = v[j - 1], v[j - 1] = c;
+			}
+		for (tc = &m->stack; *tc; tc = &(*tc)->snext);
+		for (i = 0; i < n; tc = &v[i++]->snext)
+			*tc = v[i];
+		*tc = NULL;
+		for (c = m->stack; c && !ISVISIBLE(c); c = c->snext);
+		m->sel = c;
+		if (m->num == restoring->selmon)
+			selmon = m;
+	}
+	free(v);
+	free(cs);
+	st_free(restoring);
+	free(restoring);
+	restoring = NULL;
+	arrange(NULL);
+	focus(NULL);
+}
+
 int
 applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 {
-	int baseismin;
 	Monitor *m = c->mon;
 
 	/* set minimum possible */
@@ -103,37 +264,9 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 	if (*w < bh)
 		*w = bh;
 	if (resizehints || c->isfloating || !c->mon->lt[c->mon->sellt]->arrange) {
-		if (!c->hintsvalid)
+		if (!c->info->hintsvalid)
 			updatesizehints(c);
-		/* see last two sentences in ICCCM 4.1.2.3 */
-		baseismin = c->basew == c->minw && c->baseh == c->minh;
-		if (!baseismin) { /* temporarily remove base dimensions */
-			*w -= c->basew;
-			*h -= c->baseh;
-		}
-		/* adjust for aspect limits */
-		if (c->mina > 0 && c->maxa > 0) {
-			if (c->maxa < (float)*w / *h)
-				*w = *h * c->maxa + 0.5;
-			else if (c->mina < (float)*h / *w)
-				*h = *w * c->mina + 0.5;
-		}
-		if (baseismin) { /* increment calculation requires this */
-			*w -= c->basew;
-			*h -= c->baseh;
-		}
-		/* adjust for increment value */
-		if (c->incw)
-			*w -= *w % c->incw;
-		if (c->inch)
-			*h -= *h % c->inch;
-		/* restore base dimensions */
-		*w = MAX(*w + c->basew, c->minw);
-		*h = MAX(*h + c->baseh, c->minh);
-		if (c->maxw)
-			*w = MIN(*w, c->maxw);
-		if (c->maxh)
-			*h = MIN(*h, c->maxh);
+		applyhints(&c->info->hints, w, h);
 	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
@@ -283,15 +416,15 @@ buttonpress(XEvent *e)
 		XAllowEvents(dpy, ReplayPointer, CurrentTime);
 		click = ClkClientWin;
 	}
-	for (i = 0; i < LENGTH(buttons); i++)
+	for (i = 0; i < cfg.nbuttons; i++)
 		if (
-			click == buttons[i].click && buttons[i].func &&
-			buttons[i].button == ev->button &&
-			CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state)) {
-			buttons[i].func(
-				((click == ClkTagBar || click == ClkTabBar) && buttons[i].arg.i == 0)
+			click == cfg.buttons[i].click && cfg.buttons[i].func &&
+			cfg.buttons[i].button == ev->button &&
+			CLEANMASK(cfg.buttons[i].mask) == CLEANMASK(ev->state)) {
+			cfg.buttons[i].func(
+				((click == ClkTagBar || click == ClkTabBar) && cfg.buttons[i].arg.i == 0)
 					? &arg
-					: &buttons[i].arg);
+					: &cfg.buttons[i].arg);
 		}
 }
 
@@ -415,8 +548,12 @@ cleanup(void)
 	Arg a = {.ui = ~0};
 	Layout foo = { "", NULL };
 	Monitor *m;
+	Helper *h;
 	size_t i;
 
+	/* a clean exit leaves nothing to recover */
+	jn_free(journal, 1);
+	journal = NULL;
 	view(&a);
 	selmon->lt[selmon->sellt] = &foo;
 	for (m = mons; m; m = m->next)
@@ -430,13 +567,59 @@ cleanup(void)
 		XUnmapWindow(dpy, systray->win);
 		XDestroyWindow(dpy, systray->win);
 		free(systray);
+		slab_release(&trayslab);
 	}
+	slab_release(&clientslab);
 
 	for (i = 0; i < CurLast; i++)
 		drw_cur_free(drw, cursor[i]);
 	for (i = 0; i < LENGTH(colors) + 1; i++)
 		free(scheme[i]);
 	free(scheme);
+	ri_free(ruleindex);
+	freeconfig(&cfg);
+	if (inotifyfd >= 0)
+		close(inotifyfd);
+	if (sigfd >= 0)
+		close(sigfd);
+	while ((h = helpers)) {
+		helpers = h->next;
+		close(h->fd);
+		free(h);
+	}
+	for (i = 0; i < LENGTH(blocks); i++) {
+		if (statusblocks[i].timer >= 0) {
+			close(statusblocks[i].timer);
+			sb_close(&statusblocks[i].src);
+		}
+	}
+	free(statusblocks);
+	free(buttongrabs);
+	free(keycodesyms);
+	free(pending);
+	free(deferred);
+	if (statustimer >= 0)
+		close(statustimer);
+	if (modetimer >= 0)
+		close(modetimer);
+	if (titletimer >= 0)
+		close(titletimer);
+	if (statusfd >= 0) {
+		close(statusfd);
+		unlink(statuspath);
+	}
+	if (epfd >= 0)
+		close(epfd);
+	while (ipcconns)
+		ipc_close(ipcconns);
+	if (ipcfd >= 0) {
+		close(ipcfd);
+		unlink(ipcpath);
+	}
+	free(watches);
+	free(clientlist.mapped);
+	free(clientlist.stacked);
+	free(clientlist.written);
 	XDestroyWindow(dpy, wmcheckwin);
 	drw_free(drw);
 	XSync(dpy, False);
@@ -462,6 +645,56 @@ cleanupmon(Monitor *mon)
 	free(mon);
 }
 
+void
+collectstate(SavedState *st)
+{
+	ClientState *cs;
+	Client *c;
+	Monitor *m;
+	uint32_t i, n;
+
+	memset(st, 0, sizeof *st);
+	for (m = mons; m; m = m->next, st->nmons++)
+		for (c = m->clients; c; c = c->next)
+			st->nclients++;
+	st->mons = ecalloc(st->nmons + 1, sizeof(MonState));
+	st->clients = ecalloc(st->nclients + 1, sizeof(ClientState));
+	st->selmon = selmon->num;
+	for (m = mons, i = 0, cs = st->clients; m; m = m->next) {
+		fillmonstate(m, &st->mons[i++]);
+		numberstack(m);
+		for (c = m->clients, n = 0; c; c = c->next, cs++, n++)
+			fillclientstate(c, cs, n);
+	}
+}
+
+void
+compactjournal(void)
+{
+	SavedState st;
+	Journal *j;
+	Client *c;
+	Monitor *m;
+	uint32_t i;
+
+	if (!journalpath[0])
+		return;
+	collectstate(&st);
+	if (!(j = jn_create(journalpath, session, &st)))
+		fprintf(stderr, "dwm: cannot write %s: %s\n", journalpath, strerror(errno));
+	st_free(&st);
+	jn_free(journal, 0);
+	if (!(journal = j))
+		return;
+	for (m = mons; m; m = m->next) {
+		fillmonstate(m, &m->js);
+		numberstack(m);
+		for (c = m->clients, i = 0; c; c = c->next, i++)
+			fillclientstate(c, &c->js, i);
+	}
+	journalsel = selmon->num;
+}
+
 int cmpint(const void* p1, const void* p2)
 {
 	/* The actual arguments to this function are "pointers to
@@ -477,50 +710,45 @@ clientmessage(XEvent *e)
 	XSetWindowAttributes swa;
 	XClientMessageEvent *cme = &e->xclient;
 	Client *c = wintoclient(cme->window);
+	TrayIcon *i;
 
 	if (showsystray && cme->window == systray->win && cme->message_type == netatom[NetSystemTrayOP]) {
 		/* add systray icons */
 		if (cme->data.l[1] == SYSTEM_TRAY_REQUEST_DOCK) {
-			if (!(c = (Client *)calloc(1, sizeof(Client))))
-				die("fatal: could not malloc() %u bytes\n", sizeof(Client));
-			if (!(c->win = cme->data.l[2])) {
-				free(c);
+			if (!cme->data.l[2])
 				return;
-			}
-			c->mon = selmon;
-			c->next = systray->icons;
-			systray->icons = c;
-			if (!XGetWindowAttributes(dpy, c->win, &wa)) {
+			i = slab_alloc(&trayslab);
+			i->win = cme->data.l[2];
+			i->next = systray->icons;
+			systray->icons = i;
+			if (!XGetWindowAttributes(dpy, i->win, &wa)) {
 				/* use sane defaults */
 				wa.width = bh;
 				wa.height = bh;
 				wa.border_width = 0;
 			}
-			c->x = c->oldx = c->y = c->oldy = 0;
-			c->w = c->oldw = wa.width;
-			c->h = c->oldh = wa.height;
-			c->oldbw = wa.border_width;
-			c->bw = 0;
-			c->isfloating = True;
-			/* reuse tags field as mapped status */
-			c->tags = 1;
-			updatesizehints(c);
-			updatesystrayicongeom(c, wa.width, wa.height);
-			XAddToSaveSet(dpy, c->win);
-			XSelectInput(dpy, c->win, StructureNotifyMask | PropertyChangeMask | ResizeRedirectMask);
-			XReparentWindow(dpy, c->win, systray->win, 0, 0);
+			i->w = wa.width;
+			i->h = wa.height;
+			i->mapped = 1;
+			getsizehints(i->win, &i->hints);
+			updatesystrayicongeom(i, wa.width, wa.height);
+			i->dirty = 1;
+			systray->w = 0;
+			XAddToSaveSet(dpy, i->win);
+			XSelectInput(dpy, i->win, StructureNotifyMask | PropertyChangeMask | ResizeRedirectMask);
+			XReparentWindow(dpy, i->win, systray->win, 0, 0);
 			/* use parents background color */
 			swa.background_pixel  = scheme[SchemeNorm][ColBg].pixel;
-			XChangeWindowAttributes(dpy, c->win, CWBackPixel, &swa);
-			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_EMBEDDED_NOTIFY, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
+			XChangeWindowAttributes(dpy, i->win, CWBackPixel, &swa);
+			sendevent(i->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_EMBEDDED_NOTIFY, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
 			/* FIXME not sure if I have to send these events, too */
-			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_FOCUS_IN, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
-			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_WINDOW_ACTIVATE, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
-			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_MODALITY_ON, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
+			sendevent(i->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_FOCUS_IN, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
+			sendevent(i->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_WINDOW_ACTIVATE, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
+			sendevent(i->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_MODALITY_ON, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
 			XSync(dpy, False);
 			resizebarwin(selmon);
 			updatesystray();
-			setclientstate(c, NormalState);
+			setclientstate(i->win, NormalState);
 		}
 		return;
 	}
@@ -538,6 +766,76 @@ clientmessage(XEvent *e)
 	}
 }
 
+void
+configchanged(int fd)
+{
+	long buf[1024]; /* aligned for struct inotify_event */
+	const struct inotify_event *ev;
+	const char *p;
+	ssize_t n;
+	int rules = 0, config = 0;
+
+	while ((n = read(fd, buf, sizeof buf)) > 0)
+		for (p = (char *)buf; p < (char *)buf + n; p += sizeof *ev + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (ev->len && !strcmp(ev->name, rulesfile))
+				rules = 1;
+			else if (ev->len && !strcmp(ev->name, configfile))
+				config = 1;
+		}
+	if (rules)
+		loadrules();
+	if (config)
+		reloadconfig();
+}
+
+void *
+configown(Config *c, void *p)
+{
+	c->mem = erealloc(c->mem, (c->nmem + 1) * sizeof(void *));
+	return c->mem[c->nmem++] = p;
+}
+
+int
+configpath(char *buf, size_t size, const char *name)
+{
+	const char *dir;
+	int n;
+
+	if ((dir = getenv("XDG_CONFIG_HOME")) && *dir)
+		n = snprintf(buf, size, "%s/dwm/%s", dir, name);
+	else if ((dir = getenv("HOME")))
+		n = snprintf(buf, size, "%s/.config/dwm/%s", dir, name);
+	else
+		return 0;
+	return n > 0 && n < size;
+}
+
+char *
+configstr(Config *c, const char *s)
+{
+	size_t n = strlen(s) + 1;
+
+	return memcpy(configown(c, ecalloc(n, 1)), s, n);
+}
+
+/* splits off the next blank separated word, *s is left at the one after */
+char *
+configword(char **s)
+{
+	char *w;
+
+	*s += strspn(*s, " \t");
+	if (!**s)
+		return NULL;
+	w = *s;
+	*s += strcspn(*s, " \t");
+	if (**s)
+		*(*s)++ = '\0';
+	*s += strspn(*s, " \t");
+	return w;
+}
+
 void
 configure(Client *c)
 {
@@ -695,16 +993,45 @@ deck(Monitor *m) {
 			resize(c, m->wx + mw, m->wy, m->ww - mw - (2*c->bw), m->wh - (2*c->bw), False);
 }
 
+void
+defaultconfig(Config *c)
+{
+	unsigned int i, j;
+	Key k;
+
+	memset(c, 0, sizeof *c);
+	c->nkeys = LENGTH(keys);
+	c->keys = ecalloc(c->nkeys, sizeof(Key));
+	memcpy(c->keys, keys, sizeof keys);
+	/* insertion sort, keeping bindings of the same combination in order */
+	for (i = 1; i < c->nkeys; i++) {
+		k = c->keys[i];
+		for (j = i; j > 0 && keycmp(&c->keys[j - 1], &k) > 0; j--)
+			c->keys[j] = c->keys[j - 1];
+		c->keys[j] = k;
+	}
+	c->nbuttons = LENGTH(buttons);
+	c->buttons = ecalloc(c->nbuttons, sizeof(Button));
+	memcpy(c->buttons, buttons, sizeof buttons);
+	c->nfonts = LENGTH(fonts);
+	c->fonts = ecalloc(c->nfonts, sizeof(char *));
+	memcpy(c->fonts, fonts, sizeof fonts);
+	c->deffonts = 1;
+	c->colors = ecalloc(LENGTH(colors) * 3, sizeof(char *));
+	memcpy(c->colors, colors, sizeof colors);
+}
+
 void
 destroynotify(XEvent *e)
 {
 	Client *c;
+	TrayIcon *i;
 	XDestroyWindowEvent *ev = &e->xdestroywindow;
 
 	if ((c = wintoclient(ev->window)))
 		unmanage(c, 1);
-	else if ((c = wintosystrayicon(ev->window))) {
-		removesystrayicon(c);
+	else if ((i = wintosystrayicon(ev->window))) {
+		removesystrayicon(i);
 		resizebarwin(selmon);
 		updatesystray();
 	}
@@ -870,7 +1197,7 @@ drawbar(Monitor *m)
 	unsigned int i, occ = 0, urg = 0;
 	Client *c;
 
-	if (!m->showbar)
+	if (!m->showbar || deferdraw)
 		return;
 
 	if(showsystray && m == systraytomon(m) && !systrayonleft)
@@ -918,7 +1245,7 @@ drawbar(Monitor *m)
 				w,
 				bh,
 				lrpad / 2 + (m->sel->icon ? m->sel->icw + ICONSPACING : 0),
-				m->sel->name,
+				m->sel->info->name,
 				0);
 			if (m->sel->icon)
 				drw_pic(
@@ -947,6 +1274,14 @@ drawbars(void)
 		drawbar(m);
 }
 
+/* redraws the background behind the icons */
+void
+drawsystray(void)
+{
+	XSetForeground(dpy, drw->gc, scheme[SchemeNorm][ColBg].pixel);
+	XFillRectangle(dpy, systray->win, drw->gc, 0, 0, systray->ww, bh);
+}
+
 void drawtab(Monitor* m)
 {
 	Client* c;
@@ -960,6 +1295,9 @@ void drawtab(Monitor* m)
 	int     x       = 0;
 	int     w       = 0;
 
+	if (deferdraw)
+		return;
+
 	// view_info: indicate the tag which is displayed in the view
 	for (i = 0; i < LENGTH(tags); ++i) {
 		if ((selmon->tagset[selmon->seltags] >> i) & 1) {
@@ -985,7 +1323,7 @@ void drawtab(Monitor* m)
 	for (c = m->clients; c; c = c->next) {
 		if (! ISVISIBLE(c))
 			continue;
-		m->tab_widths[m->ntabs] = TEXTW(c->name);
+		m->tab_widths[m->ntabs] = TEXTW(c->info->name);
 		tot_width += m->tab_widths[m->ntabs];
 		++m->ntabs;
 		if (m->ntabs >= MAXTABS)
@@ -1016,7 +1354,7 @@ void drawtab(Monitor* m)
 			m->tab_widths[i] = maxsize;
 		w = m->tab_widths[i];
 		drw_setscheme(drw, scheme[(c == m->sel) ? SchemeSel : SchemeNorm]);
-		drw_text(drw, x, 0, w, th, 0, c->name, 0);
+		drw_text(drw, x, 0, w, th, 0, c->info->name, 0);
 		x += w;
 		++i;
 	}
@@ -1048,14 +1386,202 @@ expose(XEvent *e)
 	Monitor *m;
 	XExposeEvent *ev = &e->xexpose;
 
-	if (ev->count == 0 && (m = wintomon(ev->window))) {
+	if (ev->count != 0)
+		return;
+	if (showsystray && systray && ev->window == systray->win)
+		drawsystray();
+	else if ((m = wintomon(ev->window))) {
 		drawbar(m);
-		if (m == selmon)
-			updatesystray();
 		drawtab(m);
 	}
 }
 
+void
+fillclientstate(Client *c, ClientState *cs, uint32_t pos)
+{
+	memset(cs, 0, sizeof *cs);
+	cs->win = c->win;
+	cs->mon = c->mon->num;
+	cs->pos = pos;
+	cs->stack = c->stackpos;
+	cs->tags = c->tags;
+	cs->isfloating = c->isfloating;
+	cs->x = c->x;
+	cs->y = c->y;
+	cs->w = c->w;
+	cs->h = c->h;
+	cs->sfx = c->sfx;
+	cs->sfy = c->sfy;
+	cs->sfw = c->sfw;
+	cs->sfh = c->sfh;
+	cs->floatborderpx = c->floatborderpx;
+	cs->hasfloatbw = c->hasfloatbw;
+	cs->scratchkey = c->scratchkey;
+	/* tiled geometry follows from the layout, keep it out of the journal */
+	if (!c->isfloating)
+		cs->x = cs->y = cs->w = cs->h = 0;
+}
+
+void
+fillmonstate(Monitor *m, MonState *ms)
+{
+	memset(ms, 0, sizeof *ms);
+	ms->num = m->num;
+	ms->tagset[0] = m->tagset[0];
+	ms->tagset[1] = m->tagset[1];
+	ms->seltags = m->seltags;
+	ms->sellt = m->sellt;
+	ms->lt[0] = m->lt[0] - layouts;
+	ms->lt[1] = m->lt[1] - layouts;
+	ms->mfact = m->mfact;
+	ms->nmaster = m->nmaster;
+	ms->showbar = m->showbar;
+	ms->showtab = m->showtab;
+}
+
+/* the first key bound to sym in mode, or where it would go */
+unsigned int
+findkey(const Config *c, unsigned int mode, KeySym sym)
+{
+	unsigned int lo = 0, hi = c->nkeys, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (c->keys[mid].mode < mode
+		|| (c->keys[mid].mode == mode && c->keys[mid].keysym < sym))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* runs the events queueevent() held back, structural ones in the order they
+ * came, then the latest property and expose update of each window */
+void
+flushevents(void)
+{
+	unsigned int i;
+
+	/* the nested loops of movemouse() and resizemouse() do not queue,
+	 * they flush first */
+	for (i = 0; i < npending; i++)
+		handler[pending[i].type](&pending[i]);
+	npending = 0;
+	for (i = 0; i < ndeferred; i++)
+		handler[deferred[i].type](&deferred[i]);
+	ndeferred = 0;
+}
+
+/* journals whatever changed since the last call, once per batch of events */
+void
+flushstate(void)
+{
+	ClientState cs;
+	MonState ms;
+	Client *c;
+	Monitor *m;
+	uint32_t num, i;
+
+	if (!journal)
+		return;
+	for (m = mons; m; m = m->next) {
+		fillmonstate(m, &ms);
+		if (memcmp(&ms, &m->js, sizeof ms)) {
+			if (!jn_append(journal, JnMon, &ms))
+				goto full;
+			m->js = ms;
+		}
+		numberstack(m);
+		for (c = m->clients, i = 0; c; c = c->next, i++) {
+			fillclientstate(c, &cs, i);
+			if (memcmp(&cs, &c->js, sizeof cs)) {
+				if (!jn_append(journal, JnClient, &cs))
+					goto full;
+				c->js = cs;
+			}
+		}
+	}
+	if (selmon->num != journalsel) {
+		num = selmon->num;
+		if (!jn_append(journal, JnSelMon, &num))
+			goto full;
+		journalsel = num;
+	}
+	return;
+full:
+	compactjournal();
+}
+
+/* redraws the status once per batch of events and ticks */
+void
+flushstatus(void)
+{
+	size_t len;
+	int i;
+	long long now;
+
+	if (!statusdirty || statuswait)
+		return;
+	/* hold back redraws closer than statusdelay, the timer brings us back */
+	now = nowms();
+	if (now - statusdrawn < statusdelay
+	&& settimer(statustimer, statusdelay - (now - statusdrawn))) {
+		statuswait = 1;
+		return;
+	}
+	statusdirty = 0;
+	statusdrawn = now;
+	len = snprintf(stext, sizeof stext, "%s", rootname);
+	for (i = 0; i < LENGTH(blocks) && len < sizeof stext; i++)
+		len += snprintf(stext + len, sizeof stext - len, "%s", statusblocks[i].text);
+	if (!stext[0])
+		strcpy(stext, "dwm-"VERSION);
+	drawbar(selmon);
+	/* only a tray left of the status moves with it */
+	if (systrayonleft)
+		updatesystray();
+}
+
+/* reads and draws the titles that changed, each at most once per
+ * titledelay, and sets the timer for the ones held back */
+void
+flushtitles(void)
+{
+	Monitor *m;
+	Client *c;
+	long long now, next = 0, due;
+	int drawsel, retab;
+
+	if (!titlesdirty)
+		return;
+	titlesdirty = 0;
+	now = nowms();
+	for (m = mons; m; m = m->next) {
+		drawsel = retab = 0;
+		for (c = m->clients; c; c = c->next) {
+			if (!c->titlestale)
+				continue;
+			due = c->info->titleread + (c == m->sel ? seltitledelay : titledelay);
+			if (due > now) {
+				next = next && next < due ? next : due;
+				continue;
+			}
+			updatetitle(c);
+			c->titlestale = 0;
+			c->info->titleread = now;
+			drawsel |= c == m->sel;
+			retab = 1;
+		}
+		if (drawsel)
+			drawbar(m);
+		if (retab)
+			drawtab(m);
+	}
+	if (next)
+		settimer(titletimer, next - now);
+}
+
 void
 focus(Client *c)
 {
@@ -1068,6 +1594,8 @@ focus(Client *c)
 			selmon = c->mon;
 		if (c->isurgent)
 			seturgent(c, 0);
+		if (c->titlestale) /* now due after seltitledelay */
+			titlesdirty = 1;
 		detachstack(c);
 		attachstack(c);
 		grabbuttons(c, 1);
@@ -1137,22 +1665,27 @@ focusmon(const Arg *arg)
 void
 focusstack(const Arg *arg)
 {
-	Client *c = NULL, *i;
+	Client *c = NULL, *from, *i;
+	int n;
 
 	if (!selmon->sel || (selmon->sel->isfullscreen && lockfullscreen))
 		return;
-	if (arg->i > 0) {
-		for (c = selmon->sel->next; c && !ISVISIBLE(c); c = c->next);
-		if (!c)
-			for (c = selmon->clients; c && !ISVISIBLE(c); c = c->next);
-	} else {
-		for (i = selmon->clients; i != selmon->sel; i = i->next)
-			if (ISVISIBLE(i))
-				c = i;
-		if (!c)
-			for (; i; i = i->next)
+	/* |arg->i| steps, focusing only the last */
+	for (n = abs(arg->i), from = selmon->sel; n > 0 && from; n--, from = c) {
+		c = NULL;
+		if (arg->i > 0) {
+			for (c = from->next; c && !ISVISIBLE(c); c = c->next);
+			if (!c)
+				for (c = selmon->clients; c && !ISVISIBLE(c); c = c->next);
+		} else {
+			for (i = selmon->clients; i != from; i = i->next)
 				if (ISVISIBLE(i))
 					c = i;
+			if (!c)
+				for (; i; i = i->next)
+					if (ISVISIBLE(i))
+						c = i;
+		}
 	}
 	if (c) {
 		focus(c);
@@ -1174,6 +1707,56 @@ void focuswin(const Arg* arg)
 	}
 }
 
+/* folds the autorepeats of ev already queued behind it into arg, so that
+ * holding a key moves focus, the stack, mfact or nmaster once by the sum */
+void
+foldrepeats(void (*func)(const Arg *), Arg *arg, XKeyEvent *ev)
+{
+	XEvent next;
+	int n = 0;
+	float f;
+
+	if (func != focusstack && func != movestack && func != incnmaster
+	&& (func != setmfact || arg->f <= -1.0 || arg->f >= 1.0))
+		return;
+	/* autorepeat without detectable autorepeat comes as release and press */
+	while (XEventsQueued(dpy, QueuedAfterReading)) {
+		XPeekEvent(dpy, &next);
+		if ((next.type != KeyPress && next.type != KeyRelease)
+		|| next.xkey.keycode != ev->keycode || next.xkey.state != ev->state)
+			break;
+		XNextEvent(dpy, &next);
+		n += next.type == KeyPress;
+	}
+	if (!n)
+		return;
+	if (func != setmfact) {
+		arg->i *= n + 1;
+		return;
+	}
+	/* as many steps as setmfact() would have taken one by one */
+	for (n++; n > 1; n--) {
+		f = arg->f * n + selmon->mfact;
+		if (f >= 0.05 && f <= 0.95)
+			break;
+	}
+	arg->f *= n;
+}
+
+void
+freeconfig(Config *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->nmem; i++)
+		free(c->mem[i]);
+	free(c->mem);
+	free(c->keys);
+	free(c->buttons);
+	free(c->fonts);
+	free(c->colors);
+}
+
 void
 freeicon(Client *c)
 {
@@ -1184,7 +1767,7 @@ freeicon(Client *c)
 }
 
 Atom
-getatomprop(Client *c, Atom prop)
+getatomprop(Window w, Atom prop)
 {
 	int di;
 	unsigned long dl;
@@ -1198,7 +1781,7 @@ getatomprop(Client *c, Atom prop)
 	if (prop == xatom[XembedInfo])
 		req = xatom[XembedInfo];
 
-	if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, req,
+	if (XGetWindowProperty(dpy, w, prop, 0L, sizeof atom, False, req,
 		&da, &di, &dl, &dl, &p) == Success && p) {
 		atom = *(Atom *)p;
 		if (da == xatom[XembedInfo] && dl == 2)
@@ -1304,11 +1887,15 @@ Picture geticonprop(Window win, unsigned int* picw, unsigned int* pich)
 unsigned int
 getsystraywidth()
 {
-	unsigned int w = 0;
-	Client *i;
-	if(showsystray)
-		for(i = systray->icons; i; w += i->w + systrayspacing, i = i->next) ;
-	return w ? w + systrayspacing : 1;
+	TrayIcon *i;
+
+	if (!showsystray || !systray)
+		return 1;
+	if (!systray->w) {
+		for (i = systray->icons; i; systray->w += i->w + systrayspacing, i = i->next);
+		systray->w = systray->w ? systray->w + systrayspacing : 1;
+	}
+	return systray->w;
 }
 
 int
@@ -1321,6 +1908,48 @@ getrootptr(int *x, int *y)
 	return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
+void
+getsizehints(Window w, SizeHints *s)
+{
+	long msize;
+	XSizeHints size;
+
+	if (!XGetWMNormalHints(dpy, w, &size, &msize))
+		/* size is uninitialized, ensure that size.flags aren't used */
+		size.flags = PSize;
+	if (size.flags & PBaseSize) {
+		s->basew = size.base_width;
+		s->baseh = size.base_height;
+	} else if (size.flags & PMinSize) {
+		s->basew = size.min_width;
+		s->baseh = size.min_height;
+	} else
+		s->basew = s->baseh = 0;
+	if (size.flags & PResizeInc) {
+		s->incw = size.width_inc;
+		s->inch = size.height_inc;
+	} else
+		s->incw = s->inch = 0;
+	if (size.flags & PMaxSize) {
+		s->maxw = size.max_width;
+		s->maxh = size.max_height;
+	} else
+		s->maxw = s->maxh = 0;
+	if (size.flags & PMinSize) {
+		s->minw = size.min_width;
+		s->minh = size.min_height;
+	} else if (size.flags & PBaseSize) {
+		s->minw = size.base_width;
+		s->minh = size.base_height;
+	} else
+		s->minw = s->minh = 0;
+	if (size.flags & PAspect) {
+		s->mina = (float)size.min_aspect.y / size.min_aspect.x;
+		s->maxa = (float)size.max_aspect.x / size.max_aspect.y;
+	} else
+		s->maxa = s->mina = 0.0;
+}
+
 long
 getstate(Window w)
 {
@@ -1339,21 +1968,42 @@ getstate(Window w)
 	return result;
 }
 
+/* reads UTF8_STRING and STRING properties straight into text, fetching no
+ * more than fits, and converts others such as COMPOUND_TEXT through the
+ * locale */
 int
 gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
 	char **list = NULL;
-	int n;
+	int n, format;
+	unsigned long len, extra;
+	unsigned char *p = NULL;
+	Atom type;
 	XTextProperty name;
 
 	if (!text || size == 0)
 		return 0;
 	text[0] = '\0';
+	if (XGetWindowProperty(dpy, w, atom, 0L, (size - 1 + 3) / 4, False, AnyPropertyType,
+		&type, &format, &len, &extra, &p) != Success)
+		return 0;
+	if (type == None) /* no such property */
+		return 0;
+	if (format == 8 && (type == utf8string || type == XA_STRING)) {
+		len = MIN(len, size - 1);
+		memcpy(text, p, len);
+		text[len] = '\0';
+		/* a title cut at size may end in half a character */
+		if (type == utf8string)
+			len = utf8trunc(text, len);
+		XFree(p);
+		return len > 0;
+	}
+	if (p)
+		XFree(p);
 	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
 		return 0;
-	if (name.encoding == XA_STRING) {
-		strncpy(text, (char *)name.value, size - 1);
-	} else if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
+	if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
 		strncpy(text, *list, size - 1);
 		XFreeStringList(list);
 	}
@@ -1362,53 +2012,72 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
 	return 1;
 }
 
+const Command *
+getcommand(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(commands); i++)
+		if (!strcmp(commands[i].name, name))
+			return &commands[i];
+	return NULL;
+}
+
+/* Sends the grabs for c's focus state when that changes. An unfocused client
+ * also gets a catch-all grab to focus it on click, and X cannot drop it
+ * without the others, so focusing ungrabs every button. Either way all of
+ * buttongrabs[] is grabbed again: after the ungrab they are gone, and on an
+ * unfocused client they are what keeps bound buttons ahead of the catch-all.
+ * What this saves over ungrabbing and grabbing every time is the ungrab
+ * when unfocusing and any request at all when nothing changes. */
 void
 grabbuttons(Client *c, int focused)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	unsigned int i;
+	int state = focused ? GrabFocused : GrabUnfocused;
+
+	if (c->grabbed == state)
+		return;
+	if (focused)
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-		if (!focused)
-			XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
-				BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
-		for (i = 0; i < LENGTH(buttons); i++)
-			if (buttons[i].click == ClkClientWin)
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabButton(dpy, buttons[i].button,
-						buttons[i].mask | modifiers[j],
-						c->win, False, BUTTONMASK,
-						GrabModeAsync, GrabModeSync, None, None);
-	}
+	else
+		XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
+			BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
+	for (i = 0; i < nbuttongrabs; i++)
+		XGrabButton(dpy, buttongrabs[i].button, buttongrabs[i].mask,
+			c->win, False, BUTTONMASK, GrabModeAsync, GrabModeSync, None, None);
+	c->grabbed = state;
+}
+
+/* grabs or ungrabs code for each root key of c bound to its keysym, the
+ * others are only seen with the keyboard grabbed */
+void
+grabkey(const Config *c, int code, int grab)
+{
+	unsigned int i, j;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	KeySym sym = keycodesyms[code - minkeycode];
+
+	if (sym == NoSymbol)
+		return;
+	for (i = findkey(c, ModeRoot, sym); i < c->nkeys && c->keys[i].mode == ModeRoot
+	&& c->keys[i].keysym == sym; i++)
+		for (j = 0; j < LENGTH(modifiers); j++)
+			if (grab)
+				XGrabKey(dpy, code, c->keys[i].mod | modifiers[j], root,
+					True, GrabModeAsync, GrabModeAsync);
+			else
+				XUngrabKey(dpy, code, c->keys[i].mod | modifiers[j], root);
 }
 
 void
 grabkeys(void)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j, k;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		int start, end, skip;
-		KeySym *syms;
-
-		XUngrabKey(dpy, AnyKey, AnyModifier, root);
-		XDisplayKeycodes(dpy, &start, &end);
-		syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip);
-		if (!syms)
-			return;
-		for (k = start; k <= end; k++)
-			for (i = 0; i < LENGTH(keys); i++)
-				/* skip modifier codes, we do that ourselves */
-				if (keys[i].keysym == syms[(k - start) * skip])
-					for (j = 0; j < LENGTH(modifiers); j++)
-						XGrabKey(dpy, k,
-							 keys[i].mod | modifiers[j],
-							 root, True,
-							 GrabModeAsync, GrabModeAsync);
-		XFree(syms);
-	}
+	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	XDisplayKeycodes(dpy, &minkeycode, &maxkeycode);
+	free(keycodesyms);
+	keycodesyms = ecalloc(maxkeycode - minkeycode + 1, sizeof(KeySym));
+	updatekeycodes(minkeycode, maxkeycode - minkeycode + 1);
 }
 
 void
@@ -1418,6 +2087,297 @@ incnmaster(const Arg *arg)
 	arrange(selmon);
 }
 
+void
+ipcaccept(int fd)
+{
+	IpcConn *c;
+
+	while ((c = ipc_accept(fd)))
+		watchfd(c->fd, ipcread);
+}
+
+/* applies all operations or, if one is invalid, none of them, then arranges
+ * and redraws every monitor they touched once */
+void
+ipcbatch(IpcConn *c, char *args)
+{
+	BatchOp *ops = NULL;
+	Monitor *m;
+	const char *err = NULL;
+	char *op;
+	size_t i, n = 0, cap = 0;
+
+	for (op = strtok(args, ";"); op; op = strtok(NULL, ";")) {
+		if (!op[strspn(op, " \t")])
+			continue;
+		if (n == cap) {
+			cap = cap ? cap * 2 : 16;
+			ops = erealloc(ops, cap * sizeof *ops);
+		}
+		if ((err = parsebatch(&ops[n], op)))
+			break;
+		n++;
+	}
+	if (err) {
+		ipc_printf(c, "{\"error\":\"operation %zu: %s\"}\n", n + 1, err);
+		free(ops);
+		return;
+	}
+
+	deferdraw = 1;
+	for (i = 0; i < n; i++)
+		applybatch(&ops[i]);
+	for (m = mons; m; m = m->next) {
+		for (i = 0; i < n && ops[i].m != m && ops[i].from != m; i++);
+		if (i == n)
+			continue;
+		if (m == selmon)
+			focus(NULL);
+		else if (!m->sel || !ISVISIBLE(m->sel))
+			/* pick as focus() does, the input focus stays on selmon */
+			for (m->sel = m->stack; m->sel && !ISVISIBLE(m->sel); m->sel = m->sel->snext);
+		arrange(m);
+	}
+	deferdraw = 0;
+	for (m = mons; m; m = m->next) {
+		for (i = 0; i < n && ops[i].m != m && ops[i].from != m; i++);
+		if (i == n)
+			continue;
+		drawbar(m);
+		drawtab(m);
+	}
+	free(ops);
+	ipc_printf(c, "{\"ok\":true,\"operations\":%zu}\n", n);
+}
+
+void
+ipcclients(IpcConn *c, char *args)
+{
+	Client *cl;
+	Monitor *m;
+	const char *sep = "";
+
+	ipc_printf(c, "{\"clients\":[");
+	for (m = mons; m; m = m->next)
+		for (cl = m->clients; cl; cl = cl->next, sep = ",") {
+			ipc_printf(c, "%s{\"window\":%lu,\"name\":", sep, cl->win);
+			ipc_printstr(c, cl->info->name);
+			ipc_printf(c, ",\"monitor\":%d,\"tags\":%u,\"floating\":%s,\"fullscreen\":%s,"
+				"\"urgent\":%s,\"focused\":%s,\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"scratchkey\":",
+				m->num, cl->tags, JSONBOOL(cl->isfloating), JSONBOOL(cl->isfullscreen),
+				JSONBOOL(cl->isurgent), JSONBOOL(cl == selmon->sel),
+				cl->x, cl->y, cl->w, cl->h);
+			if (cl->scratchkey)
+				ipc_printstr(c, (char []){ cl->scratchkey, '\0' });
+			else
+				ipc_printf(c, "null");
+			ipc_printf(c, "}");
+		}
+	ipc_printf(c, "]}\n");
+}
+
+void
+ipcdrop(IpcConn *c)
+{
+	unwatchfd(c->fd);
+	ipc_close(c);
+}
+
+void
+ipcfocus(IpcConn *c, char *args)
+{
+	ipc_printf(c, "{\"monitor\":%d,\"window\":%lu}\n",
+		selmon->num, selmon->sel ? selmon->sel->win : 0);
+}
+
+void
+ipclayouts(IpcConn *c, char *args)
+{
+	unsigned int i;
+
+	ipc_printf(c, "{\"layouts\":[");
+	for (i = 0; layouts[i].symbol; i++) {
+		ipc_printf(c, "%s", i ? "," : "");
+		ipc_printstr(c, layouts[i].symbol);
+	}
+	ipc_printf(c, "]}\n");
+}
+
+void
+ipcmonitors(IpcConn *c, char *args)
+{
+	Monitor *m;
+
+	ipc_printf(c, "{\"monitors\":[");
+	for (m = mons; m; m = m->next) {
+		ipc_printf(c, "%s{\"num\":%d,\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"selected\":%s,"
+			"\"tags\":%u,\"layout\":", m == mons ? "" : ",", m->num, m->mx, m->my,
+			m->mw, m->mh, JSONBOOL(m == selmon), m->tagset[m->seltags]);
+		ipc_printstr(c, m->ltsymbol);
+		ipc_printf(c, ",\"mfact\":%.2f,\"nmaster\":%d,\"focus\":%lu}",
+			m->mfact, m->nmaster, m->sel ? m->sel->win : 0);
+	}
+	ipc_printf(c, "]}\n");
+}
+
+/* writes what the socket takes now and the rest once it is writable */
+void
+ipcflush(IpcConn *c)
+{
+	if (!ipc_flush(c))
+		ipcdrop(c);
+	else
+		watchout(c->fd, c->outlen > 0);
+}
+
+/* sends subscribers what changed during the last batch of events */
+void
+ipcnotify(void)
+{
+	IpcConn *c, *next;
+	Client *cl;
+	Monitor *m;
+	unsigned int occ, urg;
+	Window sel = selmon->sel ? selmon->sel->win : 0;
+
+	for (m = mons; m; m = m->next) {
+		montags(m, &occ, &urg);
+		if (m->seen.tags != m->tagset[m->seltags] || m->seen.occ != occ || m->seen.urg != urg) {
+			m->seen.tags = m->tagset[m->seltags];
+			m->seen.occ = occ;
+			m->seen.urg = urg;
+			for (c = ipcconns; c; c = c->next)
+				if (c->subs & IpcTag)
+					ipc_printf(c, "{\"event\":\"tag\",\"monitor\":%d,\"selected\":%u,"
+						"\"occupied\":%u,\"urgent\":%u}\n", m->num, m->seen.tags, occ, urg);
+		}
+		if (strcmp(m->seen.ltsymbol, m->ltsymbol)) {
+			strcpy(m->seen.ltsymbol, m->ltsymbol);
+			for (c = ipcconns; c; c = c->next)
+				if (c->subs & IpcLayout) {
+					ipc_printf(c, "{\"event\":\"layout\",\"monitor\":%d,\"symbol\":", m->num);
+					ipc_printstr(c, m->ltsymbol);
+					ipc_printf(c, "}\n");
+				}
+		}
+		for (cl = m->clients; cl; cl = cl->next) {
+			if (!cl->titlechanged)
+				continue;
+			cl->titlechanged = 0;
+			for (c = ipcconns; c; c = c->next)
+				if (c->subs & IpcTitle) {
+					ipc_printf(c, "{\"event\":\"title\",\"window\":%lu,\"name\":", cl->win);
+					ipc_printstr(c, cl->info->name);
+					ipc_printf(c, "}\n");
+				}
+		}
+	}
+	if (sel != ipcsel) {
+		ipcsel = sel;
+		for (c = ipcconns; c; c = c->next)
+			if (c->subs & IpcFocus) {
+				ipc_printf(c, "{\"event\":\"focus\",\"monitor\":%d,\"window\":%lu,\"name\":",
+					selmon->num, sel);
+				ipc_printstr(c, selmon->sel ? selmon->sel->info->name : "");
+				ipc_printf(c, "}\n");
+			}
+	}
+	for (c = ipcconns; c; c = next) {
+		next = c->next;
+		if (c->outlen)
+			ipcflush(c);
+	}
+}
+
+void
+ipcread(int fd)
+{
+	IpcConn *c;
+
+	if (!(c = ipc_find(fd)))
+		return;
+	if (!ipc_read(c, ipcrequest))
+		ipcdrop(c);
+	else
+		ipcflush(c);
+}
+
+void
+ipcrequest(IpcConn *c, char *line)
+{
+	unsigned int i;
+	char *p, *w;
+
+	for (p = line + strlen(line); p > line && strchr(" \t\r", p[-1]); *--p = '\0');
+	if (!(w = configword(&line)))
+		return;
+	for (i = 0; i < LENGTH(ipcrequests) && strcmp(w, ipcrequests[i].name); i++);
+	if (i < LENGTH(ipcrequests))
+		ipcrequests[i].func(c, line);
+	else
+		ipc_printf(c, "{\"error\":\"unknown request\"}\n");
+}
+
+/* runs a function of dwmrc, with the argument as written there */
+void
+ipcrun(IpcConn *c, char *args)
+{
+	Config tmp = {0};
+	const Command *cmd;
+	Arg arg;
+	char *w;
+
+	if (!(w = configword(&args)) || !(cmd = getcommand(w)))
+		ipc_printf(c, "{\"error\":\"unknown function\"}\n");
+	else if (!parsearg(&tmp, cmd->argtype, args, &arg))
+		ipc_printf(c, "{\"error\":\"invalid argument\"}\n");
+	else {
+		cmd->func(&arg);
+		ipc_printf(c, "{\"ok\":true}\n");
+	}
+	freeconfig(&tmp);
+}
+
+void
+ipcsubscribe(IpcConn *c, char *args)
+{
+	/* in the order of the Ipc event bits */
+	static const char *events[] = { "tag", "focus", "layout", "title" };
+	unsigned int i, subs = 0;
+	char *w;
+
+	while ((w = configword(&args))) {
+		for (i = 0; i < LENGTH(events) && strcmp(w, events[i]); i++);
+		if (i == LENGTH(events)) {
+			ipc_printf(c, "{\"error\":\"unknown event\"}\n");
+			return;
+		}
+		subs |= 1 << i;
+	}
+	c->subs = subs ? subs : IpcTag|IpcFocus|IpcLayout|IpcTitle;
+	ipc_printf(c, "{\"ok\":true}\n");
+}
+
+void
+ipctags(IpcConn *c, char *args)
+{
+	Monitor *m;
+	unsigned int i, occ, urg;
+
+	ipc_printf(c, "{\"tags\":[");
+	for (i = 0; i < LENGTH(tags); i++) {
+		ipc_printf(c, "%s", i ? "," : "");
+		ipc_printstr(c, tags[i]);
+	}
+	ipc_printf(c, "],\"monitors\":[");
+	for (m = mons; m; m = m->next) {
+		montags(m, &occ, &urg);
+		ipc_printf(c, "%s{\"num\":%d,\"selected\":%u,\"occupied\":%u,\"urgent\":%u}",
+			m == mons ? "" : ",", m->num, m->tagset[m->seltags], occ, urg);
+	}
+	ipc_printf(c, "]}\n");
+}
+
 #ifdef XINERAMA
 static int
 isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
@@ -1430,20 +2390,63 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 }
 #endif /* XINERAMA */
 
+int
+keycmp(const Key *a, const Key *b)
+{
+	if (a->mode != b->mode)
+		return a->mode < b->mode ? -1 : 1;
+	if (a->keysym != b->keysym)
+		return a->keysym < b->keysym ? -1 : 1;
+	return a->mod < b->mod ? -1 : a->mod > b->mod;
+}
+
+/* enters a keymode, with the keyboard grabbed so that keys bound in it
+ * need no grab of their own, or with ModeRoot leaves it */
+void
+keymode(const Arg *arg)
+{
+	if (arg->i <= ModeRoot || arg->i >= LENGTH(keymodes)) {
+		if (curmode != ModeRoot)
+			XUngrabKeyboard(dpy, CurrentTime);
+		curmode = ModeRoot;
+		settimer(modetimer, 0);
+		return;
+	}
+	if (curmode == ModeRoot && XGrabKeyboard(dpy, root, True,
+		GrabModeAsync, GrabModeAsync, CurrentTime) != GrabSuccess)
+		return;
+	curmode = arg->i;
+	settimer(modetimer, keymodes[curmode].sticky ? 0 : chordtimeout);
+}
+
 void
 keypress(XEvent *e)
 {
-	unsigned int i;
+	unsigned int i, mode = curmode;
 	KeySym keysym;
 	XKeyEvent *ev;
+	Arg arg;
 
 	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-	for (i = 0; i < LENGTH(keys); i++)
-		if (keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-		&& keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	if (ev->keycode < minkeycode || ev->keycode > maxkeycode)
+		return;
+	keysym = keycodesyms[ev->keycode - minkeycode];
+	if (mode != ModeRoot) {
+		/* modifiers of the next key of the chord */
+		if (IsModifierKey(keysym))
+			return;
+		/* a chord ends with its next key, whether bound or not */
+		if (!keymodes[mode].sticky)
+			keymode(&(Arg){ .i = ModeRoot });
+	}
+	for (i = findkey(&cfg, mode, keysym); i < cfg.nkeys && cfg.keys[i].mode == mode
+	&& cfg.keys[i].keysym == keysym; i++)
+		if (CLEANMASK(cfg.keys[i].mod) == CLEANMASK(ev->state)
+		&& cfg.keys[i].func) {
+			arg = cfg.keys[i].arg;
+			foldrepeats(cfg.keys[i].func, &arg, ev);
+			cfg.keys[i].func(&arg);
+		}
 }
 
 void
@@ -1451,7 +2454,7 @@ killclient(const Arg *arg)
 {
 	if (!selmon->sel)
 		return;
-	if (!sendevent(selmon->sel->win, wmatom[WMDelete], NoEventMask, wmatom[WMDelete], CurrentTime, 0 , 0, 0)) {
+	if (!sendprotocol(selmon->sel, WMDelete)) {
 		XGrabServer(dpy);
 		XSetErrorHandler(xerrordummy);
 		XSetCloseDownMode(dpy, DestroyAll);
@@ -1462,22 +2465,146 @@ killclient(const Arg *arg)
 	}
 }
 
+void
+layoutchosen(char *out)
+{
+	char *end;
+	long i;
+
+	i = strtol(out, &end, 10);
+	if (end == out || i < 0 || i >= LENGTH(layouts) - 1)
+		return;
+	setlayout(&((Arg) { .v = &layouts[i] }));
+}
+
 void
 layoutmenu(const Arg *arg) {
-	FILE *p;
-	char c[3], *s;
-	int i;
+	runhelper(layoutmenu_cmd, layoutchosen);
+}
 
-	if (!(p = popen(layoutmenu_cmd, "r")))
-		 return;
-	s = fgets(c, sizeof(c), p);
-	pclose(p);
+void
+listclient(Window w)
+{
+	ClientList *l = &clientlist;
 
-	if (!s || *s == '\0' || c[0] == '\0')
-		 return;
+	if (l->n == l->cap) {
+		l->cap = l->cap ? l->cap * 2 : 64;
+		l->mapped = erealloc(l->mapped, l->cap * sizeof(Window));
+		l->stacked = erealloc(l->stacked, l->cap * sizeof(Window));
+		l->written = erealloc(l->written, l->cap * sizeof(Window));
+	}
+	/* new windows are mapped on top */
+	l->mapped[l->n] = l->stacked[l->n] = w;
+	l->n++;
+	l->dirty = 1;
+}
 
-	i = atoi(c);
-	setlayout(&((Arg) { .v = &layouts[i] }));
+void
+loadrules(void)
+{
+	static const char *pats[LENGTH(rules) * RuleLast];
+	static RuleRec recs[LENGTH(rules)];
+	char path[PATH_MAX];
+	RuleIndex *ri = NULL;
+	unsigned int i;
+
+	/* the compiled rules file replaces rules[] as long as it exists */
+	if (configpath(path, sizeof path, rulesfile)
+	&& !(ri = ri_open(path)) && errno != ENOENT) {
+		fprintf(stderr, "dwm: cannot load rules from %s: %s\n", path, strerror(errno));
+		/* a bad rewrite keeps the rules in effect, only removing it
+		 * brings back rules[] */
+		if (ruleindex)
+			return;
+	}
+	if (!ri) {
+		for (i = 0; i < LENGTH(rules); i++) {
+			pats[i * RuleLast + RuleClass]    = rules[i].class;
+			pats[i * RuleLast + RuleInstance] = rules[i].instance;
+			pats[i * RuleLast + RuleTitle]    = rules[i].title;
+			recs[i].tags          = rules[i].tags;
+			recs[i].isfloating    = rules[i].isfloating;
+			recs[i].monitor       = rules[i].monitor;
+			recs[i].floatx        = rules[i].floatx;
+			recs[i].floaty        = rules[i].floaty;
+			recs[i].floatw        = rules[i].floatw;
+			recs[i].floath        = rules[i].floath;
+			recs[i].floatborderpx = rules[i].floatborderpx;
+			recs[i].scratchkey    = rules[i].scratchkey;
+		}
+		ri = ri_create(pats, recs, LENGTH(rules));
+	}
+	/* nothing holds on to the old index past applyrules() */
+	ri_free(ruleindex);
+	ruleindex = ri;
+}
+
+void
+loadstate(void)
+{
+	Atom type;
+	int format;
+	unsigned long n, extra;
+	unsigned char *p = NULL;
+	const MonState *ms;
+	Monitor *m;
+	uint32_t i, j;
+
+	/* root window properties go with the X server, so a journal is only
+	 * replayed onto the server it was written for, whose window ids it
+	 * refers to */
+	if (XGetWindowProperty(dpy, root, wmatom[DwmSession], 0L, 1L, False, XA_CARDINAL,
+		&type, &format, &n, &extra, &p) == Success && p) {
+		if (format == 32 && n == 1)
+			session = *(long *)p;
+		XFree(p);
+		p = NULL;
+	}
+	if (!session) {
+		session = (uint32_t)nowms() ^ (uint32_t)getpid() << 16;
+		session = session ? session : 1;
+		n = session;
+		XChangeProperty(dpy, root, wmatom[DwmSession], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *)&n, 1);
+	}
+
+	restoring = ecalloc(1, sizeof(SavedState));
+	/* a restart leaves its state on the root window, a crash only the journal */
+	if (XGetWindowProperty(dpy, root, wmatom[DwmState], 0L, LONG_MAX, True,
+		wmatom[DwmState], &type, &format, &n, &extra, &p) == Success && p) {
+		if (format != 8 || !st_decode(restoring, p, n))
+			fprintf(stderr, "dwm: ignoring state of a different build\n");
+		XFree(p);
+	}
+	if (!restoring->nmons && journalpath[0] && jn_replay(journalpath, session, restoring))
+		fprintf(stderr, "dwm: recovering the session from %s\n", journalpath);
+	if (!restoring->nmons) {
+		st_free(restoring);
+		free(restoring);
+		restoring = NULL;
+		return;
+	}
+	for (i = 0; i < restoring->nmons; i++) {
+		ms = &restoring->mons[i];
+		for (m = mons; m && m->num != ms->num; m = m->next);
+		if (!m)
+			continue;
+		for (j = 0; j < 2; j++) {
+			if (ms->tagset[j] & TAGMASK)
+				m->tagset[j] = ms->tagset[j] & TAGMASK;
+			if (ms->lt[j] < LENGTH(layouts) - 1)
+				m->lt[j] = &layouts[ms->lt[j]];
+		}
+		m->seltags = ms->seltags & 1;
+		m->sellt = ms->sellt & 1;
+		if (ms->mfact >= 0.05 && ms->mfact <= 0.95)
+			m->mfact = ms->mfact;
+		m->nmaster = MAX(ms->nmaster, 0);
+		m->showbar = ms->showbar;
+		m->showtab = ms->showtab;
+		updatebarpos(m);
+		resizebarwin(m);
+	}
 }
 
 void
@@ -1486,9 +2613,14 @@ manage(Window w, XWindowAttributes *wa)
 	Client *c, *t = NULL;
 	Window trans = None;
 	XWindowChanges wc;
+	const ClientState *cs = restoring ? st_client(restoring, w) : NULL;
+	Monitor *m;
 
-	c = ecalloc(1, sizeof(Client));
+	c = slab_alloc(&clientslab);
+	c->info = ecalloc(1, sizeof(ClientInfo) + 64);
+	c->info->namesize = 64; /* grown by updatetitle() */
 	c->win = w;
+	c->desktop = -2;
 	/* geometry */
 	c->x = c->oldx = wa->x;
 	c->y = c->oldy = wa->y;
@@ -1498,7 +2630,23 @@ manage(Window w, XWindowAttributes *wa)
 
 	updateicon(c);
 	updatetitle(c);
-	if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
+	XGetTransientForHint(dpy, w, &trans);
+	if (cs) {
+		/* left by a restart, no need to ask the rules again */
+		for (m = mons; m && m->num != cs->mon; m = m->next);
+		c->mon = m ? m : selmon;
+		c->tags = cs->tags & TAGMASK ? cs->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
+		c->isfloating = cs->isfloating;
+		if (cs->isfloating) {
+			c->x = cs->x;
+			c->y = cs->y;
+			c->w = cs->w;
+			c->h = cs->h;
+		}
+		c->floatborderpx = cs->floatborderpx;
+		c->hasfloatbw = cs->hasfloatbw;
+		c->scratchkey = cs->scratchkey;
+	} else if (trans != None && (t = wintoclient(trans))) {
 		c->mon = t->mon;
 		c->tags = t->tags;
 	} else {
@@ -1521,11 +2669,18 @@ manage(Window w, XWindowAttributes *wa)
 	updatewindowtype(c);
 	updatesizehints(c);
 	updatewmhints(c);
+	updateprotocols(c);
 	c->sfx = c->x;
 	c->sfy = c->y;
 	c->sfw = c->w;
 	c->sfh = c->h;
-	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
+	if (cs) {
+		c->sfx = cs->sfx;
+		c->sfy = cs->sfy;
+		c->sfw = cs->sfw;
+		c->sfh = cs->sfh;
+	}
+	XSelectInput(dpy, w, FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, 0);
 	if (!c->isfloating)
 		c->isfloating = c->oldstate = trans != None || c->isfixed;
@@ -1533,26 +2688,37 @@ manage(Window w, XWindowAttributes *wa)
 		XRaiseWindow(dpy, c->win);
 	attachabove(c);
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-		(unsigned char *) &(c->win), 1);
+	listclient(c->win);
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
-	setclientstate(c, NormalState);
+	setclientstate(c->win, NormalState);
 	if (c->mon == selmon)
 		unfocus(selmon->sel, 0);
 	c->mon->sel = c;
-	arrange(c->mon);
+	/* a restart arranges and focuses once all windows are back */
+	if (!restoring)
+		arrange(c->mon);
 	XMapWindow(dpy, c->win);
-	focus(NULL);
+	if (!restoring)
+		focus(NULL);
 }
 
 void
 mappingnotify(XEvent *e)
 {
 	XMappingEvent *ev = &e->xmapping;
+	unsigned int old = numlockmask;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
+	if (ev->request != MappingKeyboard && ev->request != MappingModifier)
+		return;
+	/* Num_Lock may have moved to another keycode or modifier */
+	updatenumlockmask();
+	if (numlockmask != old)
 		grabkeys();
+	else if (ev->request == MappingKeyboard)
+		updatekeycodes(ev->first_keycode, ev->count);
+	if (numlockmask != old)
+		regrabbuttons();
 }
 
 void
@@ -1560,8 +2726,8 @@ maprequest(XEvent *e)
 {
 	static XWindowAttributes wa;
 	XMapRequestEvent *ev = &e->xmaprequest;
+	TrayIcon *i;
 
-	Client *i;
 	if ((i = wintosystrayicon(ev->window))) {
 		sendevent(i->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_WINDOW_ACTIVATE, 0, systray->win, XEMBED_EMBEDDED_VERSION);
 		resizebarwin(selmon);
@@ -1574,6 +2740,19 @@ maprequest(XEvent *e)
 		manage(ev->window, &wa);
 }
 
+void
+montags(Monitor *m, unsigned int *occ, unsigned int *urg)
+{
+	Client *c;
+
+	*occ = *urg = 0;
+	for (c = m->clients; c; c = c->next) {
+		*occ |= c->tags;
+		if (c->isurgent)
+			*urg |= c->tags;
+	}
+}
+
 void
 monocle(Monitor *m)
 {
@@ -1598,6 +2777,9 @@ movemouse(const Arg *arg)
 	XEvent ev;
 	Time lasttime = 0;
 
+	/* the loop below handles events as they come, so run the ones
+	 * queueevent() held back before them first */
+	flushevents();
 	if (!(c = selmon->sel))
 		return;
 	restack(selmon);
@@ -1649,38 +2831,43 @@ movemouse(const Arg *arg)
 
 void movestack(const Arg* arg)
 {
-	Client *c = NULL, *p = NULL, *pc = NULL, *i;
-
-	if (arg->i > 0) {
-		/* find the client after selmon->sel */
-		for (c = selmon->sel->next; c && (! ISVISIBLE(c) || c->isfloating);
-				 c = c->next)
-			;
-		if (! c)
-			for (c = selmon->clients; c && (! ISVISIBLE(c) || c->isfloating);
+	Client *c, *p, *pc, *i;
+	int     n, moved = 0;
+
+	/* |arg->i| single moves, arranged once */
+	for (n = abs(arg->i); n > 0 && selmon->sel; n--) {
+		c = p = pc = NULL;
+		if (arg->i > 0) {
+			/* find the client after selmon->sel */
+			for (c = selmon->sel->next; c && (! ISVISIBLE(c) || c->isfloating);
 					 c = c->next)
 				;
+			if (! c)
+				for (c = selmon->clients; c && (! ISVISIBLE(c) || c->isfloating);
+						 c = c->next)
+					;
 
-	} else {
-		/* find the client before selmon->sel */
-		for (i = selmon->clients; i != selmon->sel; i = i->next)
-			if (ISVISIBLE(i) && ! i->isfloating)
-				c = i;
-		if (! c)
-			for (; i; i = i->next)
+		} else {
+			/* find the client before selmon->sel */
+			for (i = selmon->clients; i != selmon->sel; i = i->next)
 				if (ISVISIBLE(i) && ! i->isfloating)
 					c = i;
-	}
-	/* find the client before selmon->sel and c */
-	for (i = selmon->clients; i && (! p || ! pc); i = i->next) {
-		if (i->next == selmon->sel)
-			p = i;
-		if (i->next == c)
-			pc = i;
-	}
+			if (! c)
+				for (; i; i = i->next)
+					if (ISVISIBLE(i) && ! i->isfloating)
+						c = i;
+		}
+		/* find the client before selmon->sel and c */
+		for (i = selmon->clients; i && (! p || ! pc); i = i->next) {
+			if (i->next == selmon->sel)
+				p = i;
+			if (i->next == c)
+				pc = i;
+		}
 
-	/* swap c and selmon->sel selmon->clients in the selmon->clients list */
-	if (c && c != selmon->sel) {
+		/* swap c and selmon->sel selmon->clients in the selmon->clients list */
+		if (! c || c == selmon->sel)
+			break;
 		Client* temp = selmon->sel->next == c ? selmon->sel : selmon->sel->next;
 		selmon->sel->next = c->next == selmon->sel ? c : c->next;
 		c->next           = temp;
@@ -1694,9 +2881,31 @@ void movestack(const Arg* arg)
 			selmon->clients = c;
 		else if (c == selmon->clients)
 			selmon->clients = selmon->sel;
-
-		arrange(selmon);
+		moved = 1;
 	}
+	if (moved)
+		arrange(selmon);
+}
+
+/* CLOCK_MONOTONIC in ms */
+long long
+nowms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* numbers the clients of m in focus stack order, for fillclientstate() */
+void
+numberstack(Monitor *m)
+{
+	Client *c;
+	uint32_t i;
+
+	for (c = m->stack, i = 0; c; c = c->snext, i++)
+		c->stackpos = i;
 }
 
 Client *
@@ -1706,6 +2915,258 @@ nexttiled(Client *c)
 	return c;
 }
 
+int
+parsearg(Config *c, int type, char *s, Arg *arg)
+{
+	const char **argv;
+	char *end, *key = NULL;
+	long n;
+
+	memset(arg, 0, sizeof *arg);
+	switch (type) {
+	case ArgNone:
+		return !*s;
+	case ArgInt:
+		arg->i = strtol(s, &end, 0);
+		return !*end;
+	case ArgTag:
+		/* 1-based tag number, none means the clicked tag or the previous view */
+		if (!*s)
+			return 1;
+		if (!strcmp(s, "all")) {
+			arg->ui = ~0;
+			return 1;
+		}
+		n = strtol(s, &end, 10);
+		if (*end || n < 1 || n > LENGTH(tags))
+			return 0;
+		arg->ui = 1 << (n - 1);
+		return 1;
+	case ArgFloat:
+		arg->f = strtof(s, &end);
+		return *s && !*end;
+	case ArgLayout:
+		/* index into layouts[], none toggles the previous layout */
+		if (!*s)
+			return 1;
+		n = strtol(s, &end, 10);
+		if (*end || n < 0 || n >= LENGTH(layouts) - 1)
+			return 0;
+		arg->v = &layouts[n];
+		return 1;
+	case ArgMode:
+		for (n = 0; n < LENGTH(keymodes) && strcmp(s, keymodes[n].name); n++);
+		arg->i = n;
+		return n < LENGTH(keymodes);
+	case ArgScratch:
+		if (!(key = configword(&s)) || key[1])
+			return 0;
+		/* fallthrough */
+	case ArgCmd:
+		if (!*s)
+			return 0;
+		argv = configown(c, ecalloc(5, sizeof(char *)));
+		n = 0;
+		if (key)
+			argv[n++] = configstr(c, key);
+		argv[n++] = "/bin/sh";
+		argv[n++] = "-c";
+		argv[n++] = configstr(c, s);
+		arg->v = argv;
+		return 1;
+	}
+	return 0;
+}
+
+/* op target [argument], targets are window ids or monitor numbers */
+const char *
+parsebatch(BatchOp *o, char *s)
+{
+	const BatchDef *d;
+	char *w, *end;
+	unsigned long n;
+	int len = 0;
+
+	memset(o, 0, sizeof *o);
+	if (!(w = configword(&s)))
+		return "missing operation";
+	for (o->op = 0; o->op < LENGTH(batchops) && strcmp(w, batchops[o->op].name); o->op++);
+	if (o->op == LENGTH(batchops))
+		return "unknown operation";
+	d = &batchops[o->op];
+	if (!(w = configword(&s)))
+		return "missing target";
+	n = strtoul(w, &end, 0);
+	if (*end)
+		return "invalid target";
+	if (d->onclient && !(o->c = wintoclient(n)))
+		return "no such window";
+	if (!d->onclient) {
+		for (o->m = mons; o->m && o->m->num != n; o->m = o->m->next);
+		if (!o->m)
+			return "no such monitor";
+	}
+
+	if (o->op == BatchResize) {
+		if (sscanf(s, "%d %d %d %d %n", &o->x, &o->y, &o->w, &o->h, &len) != 4
+		|| s[len] || o->w < 1 || o->h < 1)
+			return "invalid argument";
+		return NULL;
+	}
+	if (!parsearg(NULL, d->argtype, s, &o->arg))
+		return "invalid argument";
+	switch (o->op) {
+	case BatchTag:
+	case BatchView:
+		if (!(o->arg.ui & TAGMASK))
+			return "invalid argument";
+		break;
+	case BatchMonitor:
+		for (o->m = mons; o->m && o->m->num != o->arg.i; o->m = o->m->next);
+		if (!o->m)
+			return "no such monitor";
+		break;
+	case BatchFloat:
+		if (o->arg.i != 0 && o->arg.i != 1)
+			return "invalid argument";
+		break;
+	case BatchLayout:
+		if (!o->arg.v)
+			return "invalid argument";
+		break;
+	case BatchMfact:
+		if (o->arg.f < 0.05 || o->arg.f > 0.95)
+			return "invalid argument";
+		break;
+	case BatchNmaster:
+		if (o->arg.i < 0)
+			return "invalid argument";
+		break;
+	}
+	return NULL;
+}
+
+int
+parseconfig(Config *c, char *line)
+{
+	char *s = line, *w, *end;
+	const Command *cmd;
+	void (*func)(const Arg *) = NULL;
+	unsigned int i, j, mask, mode = ModeRoot, click = ClkLast, button = 0;
+	KeySym keysym = NoSymbol;
+	Arg arg = {0};
+
+	if (!(w = configword(&s)) || *w == '#')
+		return 1;
+	if (!strcmp(w, "font")) {
+		if (!*s)
+			return 0;
+		/* the first font line replaces the list from dwm.h */
+		if (c->deffonts) {
+			c->nfonts = 0;
+			c->deffonts = 0;
+		}
+		c->fonts = erealloc(c->fonts, (c->nfonts + 1) * sizeof(char *));
+		c->fonts[c->nfonts++] = configstr(c, s);
+		return 1;
+	}
+	if (!strcmp(w, "color")) {
+		if (!(w = configword(&s)))
+			return 0;
+		for (i = 0; i < LENGTH(schemenames) && strcmp(w, schemenames[i]); i++);
+		if (i == LENGTH(schemenames))
+			return 0;
+		for (j = 0; j < 3 && (w = configword(&s)); j++)
+			if (strcmp(w, "-"))
+				c->colors[i * 3 + j] = configstr(c, w);
+		return j == 3 && !*s;
+	}
+	if (!strcmp(w, "key")) {
+		/* an optional keymode before the modifiers */
+		if (!(w = configword(&s)))
+			return 0;
+		for (mode = 0; mode < LENGTH(keymodes) && strcmp(w, keymodes[mode].name); mode++);
+		if (mode < LENGTH(keymodes) && !(w = configword(&s)))
+			return 0;
+		else if (mode == LENGTH(keymodes))
+			mode = ModeRoot;
+		if (!parsemods(w, &mask)
+		|| !(w = configword(&s)) || (keysym = XStringToKeysym(w)) == NoSymbol)
+			return 0;
+	} else if (!strcmp(w, "button")) {
+		if (!(w = configword(&s)))
+			return 0;
+		for (click = 0; click < ClkLast && strcmp(w, clicknames[click]); click++);
+		if (click == ClkLast || !(w = configword(&s)) || !parsemods(w, &mask)
+		|| !(w = configword(&s)) || (button = strtoul(w, &end, 10)) < Button1 || *end)
+			return 0;
+	} else
+		return 0;
+
+	/* the function and its argument, "none" drops the binding */
+	if (!(w = configword(&s)))
+		return 0;
+	if (strcmp(w, "none")) {
+		if (!(cmd = getcommand(w)) || !parsearg(c, cmd->argtype, s, &arg))
+			return 0;
+		func = cmd->func;
+	} else if (*s)
+		return 0;
+
+	/* a binding replaces every earlier one on the same combination */
+	if (keysym != NoSymbol) {
+		for (i = 0; i < c->nkeys;)
+			if (c->keys[i].mode == mode && c->keys[i].mod == mask
+			&& c->keys[i].keysym == keysym)
+				memmove(&c->keys[i], &c->keys[i + 1], (--c->nkeys - i) * sizeof(Key));
+			else
+				i++;
+		if (func) {
+			c->keys = erealloc(c->keys, (c->nkeys + 1) * sizeof(Key));
+			for (i = findkey(c, mode, keysym); i < c->nkeys && c->keys[i].mode == mode
+			&& c->keys[i].keysym == keysym && c->keys[i].mod <= mask; i++);
+			memmove(&c->keys[i + 1], &c->keys[i], (c->nkeys++ - i) * sizeof(Key));
+			c->keys[i] = (Key){ mask, keysym, func, arg, mode };
+		}
+	} else {
+		for (i = 0; i < c->nbuttons;)
+			if (c->buttons[i].click == click && c->buttons[i].mask == mask
+			&& c->buttons[i].button == button)
+				memmove(&c->buttons[i], &c->buttons[i + 1], (--c->nbuttons - i) * sizeof(Button));
+			else
+				i++;
+		if (func) {
+			c->buttons = erealloc(c->buttons, (c->nbuttons + 1) * sizeof(Button));
+			c->buttons[c->nbuttons++] = (Button){ click, mask, button, func, arg };
+		}
+	}
+	return 1;
+}
+
+int
+parsemods(char *s, unsigned int *mask)
+{
+	static const struct { const char *name; unsigned int mask; } mods[] = {
+		{ "Shift", ShiftMask }, { "Control", ControlMask }, { "Ctrl", ControlMask },
+		{ "Mod1", Mod1Mask }, { "Alt", Mod1Mask }, { "Mod2", Mod2Mask },
+		{ "Mod3", Mod3Mask }, { "Mod4", Mod4Mask }, { "Super", Mod4Mask },
+		{ "Mod5", Mod5Mask }, { "MODKEY", MODKEY },
+	};
+	unsigned int i;
+	char *m;
+
+	*mask = 0;
+	if (!strcmp(s, "0") || !strcmp(s, "none"))
+		return 1;
+	for (m = strtok(s, "+"); m; m = strtok(NULL, "+")) {
+		for (i = 0; i < LENGTH(mods) && strcmp(m, mods[i].name); i++);
+		if (i == LENGTH(mods))
+			return 0;
+		*mask |= mods[i].mask;
+	}
+	return 1;
+}
+
 void
 pop(Client *c)
 {
@@ -1731,24 +3192,28 @@ void
 propertynotify(XEvent *e)
 {
 	Client *c;
+	TrayIcon *i;
 	Window trans;
 	XPropertyEvent *ev = &e->xproperty;
 
-	if ((c = wintosystrayicon(ev->window))) {
+	if ((i = wintosystrayicon(ev->window))) {
 		if (ev->atom == XA_WM_NORMAL_HINTS) {
-			updatesizehints(c);
-			updatesystrayicongeom(c, c->w, c->h);
+			getsizehints(i->win, &i->hints);
+			updatesystrayicongeom(i, i->w, i->h);
+			resizebarwin(selmon);
+			updatesystray();
 		}
 		else
-			updatesystrayiconstate(c, ev);
-		resizebarwin(selmon);
-		updatesystray();
+			updatesystrayiconstate(i, ev);
 	}
 
 	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
 		updatestatus();
-	else if (ev->state == PropertyDelete)
+	else if (ev->state == PropertyDelete) {
+		if (ev->atom == wmatom[WMProtocols] && (c = wintoclient(ev->window)))
+			c->protocols = 0;
 		return; /* ignore */
+	}
 	else if ((c = wintoclient(ev->window))) {
 		switch(ev->atom) {
 		default: break;
@@ -1758,7 +3223,7 @@ propertynotify(XEvent *e)
 				arrange(c->mon);
 			break;
 		case XA_WM_NORMAL_HINTS:
-			c->hintsvalid = 0;
+			c->info->hintsvalid = 0;
 			break;
 		case XA_WM_HINTS:
 			updatewmhints(c);
@@ -1766,53 +3231,376 @@ propertynotify(XEvent *e)
 			drawtabs();
 			break;
 		}
+		if (ev->atom == wmatom[WMProtocols])
+			updateprotocols(c);
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-			updatetitle(c);
-			if (c == c->mon->sel)
-				drawbar(c->mon);
-			drawtab(c->mon);
+			c->titlestale = 1;
+			titlesdirty = 1;
 		}
 		else if (ev->atom == netatom[NetWMIcon]) {
 			updateicon(c);
 			if (c == c->mon->sel)
 				drawbar(c->mon);
 		}
-		if (ev->atom == netatom[NetWMWindowType])
-			updatewindowtype(c);
+		if (ev->atom == netatom[NetWMWindowType])
+			updatewindowtype(c);
+	}
+}
+
+/* handles input and focus as it is read, so a client flooding property
+ * changes cannot delay keys and buttons behind them, and holds back the
+ * rest for flushevents() */
+void
+queueevent(XEvent *ev)
+{
+	unsigned int i;
+
+	switch (ev->type) {
+	case KeyPress:
+	case ButtonPress:
+	case FocusIn:
+	case MappingNotify: /* keys are decoded with the current mapping */
+		handler[ev->type](ev);
+		return;
+	case PropertyNotify:
+	case Expose:
+		/* only the last state of a property matters, and any exposure
+		 * redraws the whole bar */
+		if (ev->type == Expose)
+			ev->xexpose.count = 0;
+		for (i = 0; i < ndeferred; i++)
+			if (deferred[i].type == ev->type && deferred[i].xany.window == ev->xany.window
+			&& (ev->type == Expose || deferred[i].xproperty.atom == ev->xproperty.atom))
+				break;
+		if (i == ndeferred) {
+			if (ndeferred == deferredcap) {
+				deferredcap = deferredcap ? deferredcap * 2 : 32;
+				deferred = erealloc(deferred, deferredcap * sizeof(XEvent));
+			}
+			ndeferred++;
+		}
+		deferred[i] = *ev;
+		return;
+	default:
+		if (!handler[ev->type])
+			return;
+		if (npending == pendingcap) {
+			pendingcap = pendingcap ? pendingcap * 2 : 32;
+			pending = erealloc(pending, pendingcap * sizeof(XEvent));
+		}
+		pending[npending++] = *ev;
+	}
+}
+
+void
+quit(const Arg *arg)
+{
+	running = 0;
+}
+
+int
+readconfig(Config *c)
+{
+	char path[PATH_MAX], line[1024], *p;
+	FILE *fp;
+	int n = 0, ok = 1;
+
+	defaultconfig(c);
+	if (!configpath(path, sizeof path, configfile))
+		return 1;
+	if (!(fp = fopen(path, "r"))) {
+		if (errno == ENOENT)
+			return 1;
+		fprintf(stderr, "dwm: cannot read %s: %s\n", path, strerror(errno));
+		freeconfig(c);
+		return 0;
+	}
+	while (fgets(line, sizeof line, fp)) {
+		n++;
+		for (p = line + strlen(line); p > line && strchr(" \t\n", p[-1]); *--p = '\0');
+		if (!parseconfig(c, line)) {
+			fprintf(stderr, "dwm: %s:%d: invalid line\n", path, n);
+			ok = 0;
+		}
+	}
+	fclose(fp);
+	if (!ok)
+		freeconfig(c);
+	return ok;
+}
+
+void
+readhelper(int fd)
+{
+	Helper **hp, *h;
+	char buf[BUFSIZ];
+	ssize_t n;
+
+	for (hp = &helpers; *hp && (*hp)->fd != fd; hp = &(*hp)->next);
+	if (!(h = *hp))
+		return;
+	while ((n = read(fd, buf, sizeof buf)) != 0) {
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return;
+		if (n < 0)
+			break;
+		if (n > sizeof h->out - 1 - h->len)
+			n = sizeof h->out - 1 - h->len;
+		memcpy(h->out + h->len, buf, n);
+		h->len += n;
+	}
+	/* end of output, the child itself is reaped on SIGCHLD */
+	*hp = h->next;
+	unwatchfd(fd);
+	close(fd);
+	h->out[h->len] = '\0';
+	h->done(h->out);
+	free(h);
+}
+
+/* lines of "name value" set the SbExternal block name, without a value it is
+ * hidden */
+void
+readstatus(int fd)
+{
+	char *p, *nl, *name;
+	ssize_t n;
+	int i;
+
+	while ((n = read(fd, statusin + statusinlen, sizeof statusin - statusinlen)) != 0) {
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return;
+		statusinlen += n;
+		for (p = statusin; (nl = memchr(p, '\n', statusin + statusinlen - p)); p = nl + 1) {
+			*nl = '\0';
+			if (!(name = configword(&p)))
+				continue;
+			for (i = 0; i < LENGTH(blocks); i++)
+				if (blocks[i].src == SbExternal && !strcmp(blocks[i].arg, name))
+					setblock(&statusblocks[i], &blocks[i], p);
+		}
+		statusinlen -= p - statusin;
+		memmove(statusin, p, statusinlen);
+		if (statusinlen == sizeof statusin) /* no block takes a line this long */
+			statusinlen = 0;
+	}
+}
+
+void
+readsignal(int fd)
+{
+	struct signalfd_siginfo si;
+
+	while (read(fd, &si, sizeof si) == sizeof si)
+		if (si.ssi_signo == SIGCHLD)
+			while (0 < waitpid(-1, NULL, WNOHANG));
+		else if (si.ssi_signo == SIGHUP)
+			reloadconfig();
+}
+
+Monitor *
+recttomon(int x, int y, int w, int h)
+{
+	Monitor *m, *r = selmon;
+	int a, area = 0;
+
+	for (m = mons; m; m = m->next)
+		if ((a = INTERSECT(x, y, w, h, m)) > area) {
+			area = a;
+			r = m;
+		}
+	return r;
+}
+
+/* rebuilds the grab set for the current buttons and lock modifiers and
+ * puts it on every client */
+void
+regrabbuttons(void)
+{
+	unsigned int i, j, n;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	Monitor *m;
+	Client *c;
+
+	for (i = 0, n = 0; i < cfg.nbuttons; i++)
+		n += cfg.buttons[i].click == ClkClientWin;
+	buttongrabs = erealloc(buttongrabs, MAX(n, 1) * LENGTH(modifiers) * sizeof(ButtonGrab));
+	for (i = 0, nbuttongrabs = 0; i < cfg.nbuttons; i++)
+		if (cfg.buttons[i].click == ClkClientWin)
+			for (j = 0; j < LENGTH(modifiers); j++) {
+				buttongrabs[nbuttongrabs].button = cfg.buttons[i].button;
+				buttongrabs[nbuttongrabs++].mask = cfg.buttons[i].mask | modifiers[j];
+			}
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			/* grabs built with the old buttons or mask would stay */
+			XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
+			c->grabbed = GrabNone;
+			grabbuttons(c, c == selmon->sel);
+		}
+}
+
+/* ungrabs the keys only old binds, then grabs the ones only new binds */
+void
+regrabkeys(const Config *old, const Config *new)
+{
+	unsigned int i, j, grab;
+	int k;
+	const Config *from, *to;
+	const Key *key;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+
+	for (grab = 0; grab < 2; grab++) {
+		from = grab ? new : old;
+		to = grab ? old : new;
+		for (i = 0; i < from->nkeys; i++) {
+			key = &from->keys[i];
+			if (key->mode != ModeRoot)
+				break;
+			for (j = findkey(to, ModeRoot, key->keysym); j < to->nkeys && to->keys[j].mode == ModeRoot
+			&& to->keys[j].keysym == key->keysym && to->keys[j].mod != key->mod; j++);
+			if (j < to->nkeys && to->keys[j].mode == ModeRoot && to->keys[j].keysym == key->keysym)
+				continue;
+			for (k = minkeycode; k <= maxkeycode; k++) {
+				if (key->keysym != keycodesyms[k - minkeycode])
+					continue;
+				for (j = 0; j < LENGTH(modifiers); j++)
+					if (grab)
+						XGrabKey(dpy, k, key->mod | modifiers[j], root,
+							True, GrabModeAsync, GrabModeAsync);
+					else
+						XUngrabKey(dpy, k, key->mod | modifiers[j], root);
+			}
+		}
 	}
 }
 
 void
-quit(const Arg *arg)
+readtimer(int fd)
 {
-	running = 0;
+	uint64_t expired;
+
+	while (read(fd, &expired, sizeof expired) < 0 && errno == EINTR);
+	if (fd == statustimer)
+		statuswait = 0;
+	else if (fd == modetimer)
+		keymode(&(Arg){ .i = ModeRoot });
+	else if (fd == titletimer)
+		titlesdirty = 1;
 }
 
-Monitor *
-recttomon(int x, int y, int w, int h)
+void
+reloadconfig(void)
 {
-	Monitor *m, *r = selmon;
-	int a, area = 0;
+	Config new;
+	const Config *a, *b;
+	Clr clr[LENGTH(colors) * 3];
+	int dirty[LENGTH(colors) * 3];
+	Fnt *oldfonts = NULL;
+	Client *c;
+	Monitor *m;
+	unsigned int i, j, k, recolor = 0, refont, regrab = 0;
 
-	for (m = mons; m; m = m->next)
-		if ((a = INTERSECT(x, y, w, h, m)) > area) {
-			area = a;
-			r = m;
+	if (!readconfig(&new))
+		return;
+
+	/* allocate whatever changed first, so a bad color or font leaves the
+	 * running config untouched */
+	for (i = 0; i < LENGTH(colors) * 3; i++) {
+		if (!(dirty[i] = strcmp(cfg.colors[i], new.colors[i]) != 0))
+			continue;
+		if (!drw_clr_alloc(drw, &clr[i], new.colors[i])) {
+			fprintf(stderr, "dwm: cannot allocate color '%s'\n", new.colors[i]);
+			goto fail;
 		}
-	return r;
+		recolor = 1;
+	}
+	refont = new.nfonts != cfg.nfonts;
+	for (i = 0; !refont && i < new.nfonts; i++)
+		refont = strcmp(new.fonts[i], cfg.fonts[i]) != 0;
+	if (refont) {
+		oldfonts = drw->fonts;
+		if (!drw_fontset_create(drw, new.fonts, new.nfonts)) {
+			fprintf(stderr, "dwm: no fonts could be loaded, keeping the old ones\n");
+			drw->fonts = oldfonts;
+			i = LENGTH(colors) * 3;
+			goto fail;
+		}
+	}
+
+	/* client windows only grab the ClkClientWin buttons */
+	for (j = 0; j < 2 && !regrab; j++) {
+		a = j ? &new : &cfg;
+		b = j ? &cfg : &new;
+		for (i = 0; i < a->nbuttons && !regrab; i++) {
+			if (a->buttons[i].click != ClkClientWin)
+				continue;
+			for (k = 0; k < b->nbuttons; k++)
+				if (b->buttons[k].click == ClkClientWin
+				&& b->buttons[k].mask == a->buttons[i].mask
+				&& b->buttons[k].button == a->buttons[i].button)
+					break;
+			regrab = k == b->nbuttons;
+		}
+	}
+	regrabkeys(&cfg, &new);
+	freeconfig(&cfg);
+	cfg = new;
+
+	if (regrab)
+		regrabbuttons();
+	if (recolor) {
+		for (i = 0; i < LENGTH(colors) * 3; i++)
+			if (dirty[i]) {
+				drw_clr_free(drw, &scheme[i / 3][i % 3]);
+				scheme[i / 3][i % 3] = clr[i];
+			}
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next)
+				XSetWindowBorder(dpy, c->win,
+					scheme[c == selmon->sel ? SchemeSel : SchemeNorm][ColBorder].pixel);
+	}
+	if (refont) {
+		drw_fontset_free(oldfonts);
+		lrpad = drw->fonts->h;
+		bh = drw->fonts->h + 2;
+		th = bh;
+		arrange(NULL);
+		for (m = mons; m; m = m->next)
+			resizebarwin(m);
+	}
+	if (recolor || refont) {
+		if (systray)
+			systray->dirty = 1;
+		updatesystray();
+		drawbars();
+		drawtabs();
+	}
+	return;
+
+fail:
+	for (j = 0; j < i; j++)
+		if (dirty[j])
+			drw_clr_free(drw, &clr[j]);
+	freeconfig(&new);
 }
 
 void
-removesystrayicon(Client *i)
+removesystrayicon(TrayIcon *i)
 {
-	Client **ii;
+	TrayIcon **ii;
 
 	if (!showsystray || !i)
 		return;
 	for (ii = &systray->icons; *ii && *ii != i; ii = &(*ii)->next);
-	if (ii)
+	if (*ii)
 		*ii = i->next;
-	free(i);
+	slab_free(&trayslab, i);
+	systray->w = 0;
 }
 
 void
@@ -1852,7 +3640,7 @@ void
 resizerequest(XEvent *e)
 {
 	XResizeRequestEvent *ev = &e->xresizerequest;
-	Client *i;
+	TrayIcon *i;
 
 	if ((i = wintosystrayicon(ev->window))) {
 		updatesystrayicongeom(i, ev->width, ev->height);
@@ -1870,6 +3658,9 @@ resizemouse(const Arg *arg)
 	XEvent ev;
 	Time lasttime = 0;
 
+	/* the loop below handles events as they come, so run the ones
+	 * queueevent() held back before them first */
+	flushevents();
 	if (!(c = selmon->sel))
 		return;
 	restack(selmon);
@@ -1908,7 +3699,6 @@ resizemouse(const Arg *arg)
 	} while (ev.type != ButtonRelease);
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(dpy, CurrentTime);
-	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
 	if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
 		sendmon(c, m);
 		selmon = m;
@@ -1920,37 +3710,171 @@ void
 restack(Monitor *m)
 {
 	Client *c;
-	XEvent ev;
 	XWindowChanges wc;
 
 	drawbar(m);
 	drawtab(m);
 	if (!m->sel)
 		return;
-	if (m->sel->isfloating || !m->lt[m->sellt]->arrange)
+	if (m->sel->isfloating || !m->lt[m->sellt]->arrange) {
 		XRaiseWindow(dpy, m->sel->win);
+		stackclient(m->sel->win, 1);
+	}
 	if (m->lt[m->sellt]->arrange) {
 		wc.stack_mode = Below;
 		wc.sibling = m->barwin;
 		for (c = m->stack; c; c = c->snext)
 			if (!c->isfloating && ISVISIBLE(c)) {
 				XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
+				stackclient(c->win, 0);
 				wc.sibling = c->win;
 			}
 	}
-	XSync(dpy, False);
-	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+}
+
+void
+restart(const Arg *arg)
+{
+	restarting = 1;
+	running = 0;
 }
 
 void
 run(void)
 {
 	XEvent ev;
+	struct epoll_event ready[16];
+	int i, j, n;
+
 	/* main event loop */
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-		if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	while (running) {
+		/* a batch is what was queued when it began, so a client that
+		 * keeps sending cannot hold back the rest; handlers may have
+		 * read some of it themselves */
+		n = XEventsQueued(dpy, QueuedAfterReading);
+		for (; running && n > 0 && XEventsQueued(dpy, QueuedAlready); n--) {
+			XNextEvent(dpy, &ev);
+			queueevent(&ev);
+		}
+		flushevents();
+		if (!running)
+			break;
+		updateclientlist();
+		updatedesktops();
+		flushstatus();
+		flushtitles();
+		flushstate();
+		ipcnotify();
+		XFlush(dpy);
+		/* sleep until X or one of the watched descriptors wakes us, or
+		 * just poll the descriptors if more X events are already waiting,
+		 * as events Xlib has read would not wake us */
+		if ((n = epoll_wait(epfd, ready, LENGTH(ready), XPending(dpy) ? 0 : -1)) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("dwm: epoll_wait:");
+		}
+		/* handlers may (un)watch descriptors, look each one up again */
+		for (i = 0; i < n; i++)
+			for (j = 0; j < nwatches; j++)
+				if (watches[j].fd == ready[i].data.fd) {
+					if (watches[j].func)
+						watches[j].func(ready[i].data.fd);
+					break;
+				}
+	}
+}
+
+void
+savestate(void)
+{
+	SavedState st;
+	void *blob;
+	size_t len;
+
+	collectstate(&st);
+	blob = st_encode(&st, &len);
+	XChangeProperty(dpy, root, wmatom[DwmState], wmatom[DwmState], 8,
+		PropModeReplace, blob, len);
+	free(blob);
+	st_free(&st);
+}
+
+/* runs cmd with sh(1) and hands its output to done once it closes stdout,
+ * without waiting for it */
+void
+runhelper(const char *cmd, void (*done)(char *out))
+{
+	Helper *h;
+	sigset_t sm;
+	int fd[2];
+
+	if (pipe(fd) < 0) {
+		fprintf(stderr, "dwm: pipe: %s\n", strerror(errno));
+		return;
+	}
+	switch (fork()) {
+	case -1:
+		fprintf(stderr, "dwm: fork: %s\n", strerror(errno));
+		close(fd[0]);
+		close(fd[1]);
+		return;
+	case 0:
+		if (dpy)
+			close(ConnectionNumber(dpy));
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[0]);
+		close(fd[1]);
+		setsid();
+		sigemptyset(&sm);
+		sigprocmask(SIG_SETMASK, &sm, NULL);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		die("dwm: execl '%s' failed:", cmd);
+	}
+	close(fd[1]);
+	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	h = ecalloc(1, sizeof(Helper));
+	h->fd = fd[0];
+	h->done = done;
+	h->next = helpers;
+	helpers = h;
+	watchfd(h->fd, readhelper);
+}
+
+/* $XDG_RUNTIME_DIR/dwm-$DISPLAY<suffix>, per display as every X session
+ * has its own windows. Without XDG_RUNTIME_DIR it goes in a directory of
+ * our own in /tmp, which only we may enter. */
+int
+runtimepath(char *buf, size_t size, const char *suffix)
+{
+	static char priv[32];
+	const char *dir;
+	struct stat st;
+	char *p;
+	int n;
+
+	if (!(dir = getenv("XDG_RUNTIME_DIR")) || !*dir) {
+		snprintf(priv, sizeof priv, "/tmp/dwm-%u", (unsigned int)getuid());
+		if (mkdir(priv, 0700) < 0 && errno != EEXIST)
+			return 0;
+		/* someone else may have made it first */
+		if (lstat(priv, &st) < 0)
+			return 0;
+		if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || st.st_mode & 077) {
+			errno = EPERM;
+			return 0;
+		}
+		dir = priv;
+	}
+	n = snprintf(buf, size, "%s/dwm-%s%s", dir, DisplayString(dpy), suffix);
+	if (n < 0 || n >= size)
+		return 0;
+	for (p = buf + strlen(dir) + 1; *p; p++)
+		if (*p == '/')
+			*p = '_';
+	return 1;
 }
 
 void
@@ -1996,48 +3920,41 @@ sendmon(Client *c, Monitor *m)
 	arrange(NULL);
 }
 
+/* sends WM_PROTOCOLS proto to c if it said it takes it, as of the last
+ * updateprotocols(), so focusing and closing need no round trip */
+int
+sendprotocol(Client *c, int proto)
+{
+	if (!(c->protocols & 1 << proto))
+		return 0;
+	sendevent(c->win, wmatom[WMProtocols], NoEventMask, wmatom[proto], CurrentTime, 0, 0, 0);
+	return 1;
+}
+
 void
-setclientstate(Client *c, long state)
+setclientstate(Window w, long state)
 {
 	long data[] = { state, None };
 
-	XChangeProperty(dpy, c->win, wmatom[WMState], wmatom[WMState], 32,
+	XChangeProperty(dpy, w, wmatom[WMState], wmatom[WMState], 32,
 		PropModeReplace, (unsigned char *)data, 2);
 }
 
-int
-sendevent(Window w, Atom proto, int mask, long d0, long d1, long d2, long d3, long d4)
+void
+sendevent(Window w, Atom type, int mask, long d0, long d1, long d2, long d3, long d4)
 {
-	int n;
-	Atom *protocols, mt;
-	int exists = 0;
 	XEvent ev;
 
-	if (proto == wmatom[WMTakeFocus] || proto == wmatom[WMDelete]) {
-		mt = wmatom[WMProtocols];
-		if (XGetWMProtocols(dpy, w, &protocols, &n)) {
-			while (!exists && n--)
-				exists = protocols[n] == proto;
-			XFree(protocols);
-		}
-	}
-	else {
-		exists = True;
-		mt = proto;
-	}
-	if (exists) {
-		ev.type = ClientMessage;
-		ev.xclient.window = w;
-		ev.xclient.message_type = mt;
-		ev.xclient.format = 32;
-		ev.xclient.data.l[0] = d0;
-		ev.xclient.data.l[1] = d1;
-		ev.xclient.data.l[2] = d2;
-		ev.xclient.data.l[3] = d3;
-		ev.xclient.data.l[4] = d4;
-		XSendEvent(dpy, w, False, mask, &ev);
-	}
-	return exists;
+	ev.type = ClientMessage;
+	ev.xclient.window = w;
+	ev.xclient.message_type = type;
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = d0;
+	ev.xclient.data.l[1] = d1;
+	ev.xclient.data.l[2] = d2;
+	ev.xclient.data.l[3] = d3;
+	ev.xclient.data.l[4] = d4;
+	XSendEvent(dpy, w, False, mask, &ev);
 }
 
 void
@@ -2049,7 +3966,7 @@ setfocus(Client *c)
 			XA_WINDOW, 32, PropModeReplace,
 			(unsigned char *) &(c->win), 1);
 	}
-	sendevent(c->win, wmatom[WMTakeFocus], NoEventMask, wmatom[WMTakeFocus], CurrentTime, 0, 0, 0);
+	sendprotocol(c, WMTakeFocus);
 }
 
 void
@@ -2095,15 +4012,67 @@ setmfact(const Arg *arg)
 	arrange(selmon);
 }
 
+/* an empty value hides the block */
+void
+setblock(StatusBlock *b, const Block *def, const char *value)
+{
+	char text[sizeof b->text], *p;
+	int codes = 0;
+
+	text[0] = '\0';
+	if (*value && snprintf(text, sizeof text, def->fmt, value) >= (int)sizeof text) {
+		/* cut after the last whole character outside a status code, as
+		 * drawstatusbar() reads the rest of an open one as the code */
+		utf8trunc(text, strlen(text));
+		for (p = text; (p = strchr(p, '^')); p++)
+			codes++;
+		if (codes % 2)
+			*strrchr(text, '^') = '\0';
+	}
+	if (strcmp(text, b->text)) {
+		strcpy(b->text, text);
+		statusdirty = 1;
+	}
+}
+
+/* arms the one-shot timer fd to expire in ms, disarms it for 0 */
+int
+settimer(int fd, long long ms)
+{
+	struct itimerspec its = {{0}};
+
+	its.it_value.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = ms % 1000 * 1000000;
+	return fd >= 0 && timerfd_settime(fd, 0, &its, NULL) == 0;
+}
+
 void
 setup(void)
 {
 	int i;
+	long ndesktops = LENGTH(tags);
+	size_t len;
+	char path[PATH_MAX], *names;
+	sigset_t sm;
 	XSetWindowAttributes wa;
-	Atom utf8string;
 
+	/* every descriptor, X included, wakes the one epoll_wait() in run() */
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("dwm: epoll_create1:");
+	watchfd(ConnectionNumber(dpy), NULL);
+	/* SIGCHLD reaps children and SIGHUP reloads the config file, both are
+	 * read through a descriptor */
+	sigemptyset(&sm);
+	sigaddset(&sm, SIGCHLD);
+	sigaddset(&sm, SIGHUP);
+	if (sigprocmask(SIG_BLOCK, &sm, NULL) < 0
+	|| (sigfd = signalfd(-1, &sm, SFD_NONBLOCK|SFD_CLOEXEC)) < 0)
+		die("dwm: signalfd:");
+	watchfd(sigfd, readsignal);
 	/* clean up any zombies immediately */
-	sigchld(0);
+	while (0 < waitpid(-1, NULL, WNOHANG));
+	if (!readconfig(&cfg))
+		defaultconfig(&cfg);
 
 	/* init screen */
 	screen = DefaultScreen(dpy);
@@ -2111,18 +4080,39 @@ setup(void)
 	sh = DisplayHeight(dpy, screen);
 	root = RootWindow(dpy, screen);
 	drw = drw_create(dpy, screen, root, sw, sh);
-	if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
+	if (!drw_fontset_create(drw, cfg.fonts, cfg.nfonts))
 		die("no fonts could be loaded.");
 	lrpad = drw->fonts->h;
 	bh = drw->fonts->h + 2;
 	th = bh;
 	updategeom();
+	loadrules();
+	/* reload runtime files when they change */
+	if ((inotifyfd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) >= 0) {
+		if (configpath(path, sizeof path, ".")
+		&& inotify_add_watch(inotifyfd, path, IN_CLOSE_WRITE|IN_MOVED_TO|IN_MOVED_FROM|IN_DELETE) >= 0)
+			watchfd(inotifyfd, configchanged);
+		else {
+			close(inotifyfd);
+			inotifyfd = -1;
+		}
+	}
 	/* init atoms */
 	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
 	wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
 	wmatom[WMDelete] = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 	wmatom[WMState] = XInternAtom(dpy, "WM_STATE", False);
 	wmatom[WMTakeFocus] = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
+	wmatom[DwmState] = XInternAtom(dpy, "_DWM_STATE", False);
+	wmatom[DwmSession] = XInternAtom(dpy, "_DWM_SESSION", False);
+	if (!runtimepath(journalpath, sizeof journalpath, ".journal"))
+		journalpath[0] = '\0';
+	/* answer IPC requests */
+	if (!runtimepath(ipcpath, sizeof ipcpath, ".sock")
+	|| (ipcfd = ipc_listen(ipcpath)) < 0)
+		fprintf(stderr, "dwm: cannot listen on %s: %s\n", ipcpath, strerror(errno));
+	else
+		watchfd(ipcfd, ipcaccept);
 	netatom[NetActiveWindow] = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
 	netatom[NetSupported] = XInternAtom(dpy, "_NET_SUPPORTED", False);
 	netatom[NetSystemTray] = XInternAtom(dpy, "_NET_SYSTEM_TRAY_S0", False);
@@ -2137,6 +4127,11 @@ setup(void)
 	netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
 	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	netatom[NetClientListStacking] = XInternAtom(dpy, "_NET_CLIENT_LIST_STACKING", False);
+	netatom[NetNumberOfDesktops] = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
+	netatom[NetCurrentDesktop] = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+	netatom[NetDesktopNames] = XInternAtom(dpy, "_NET_DESKTOP_NAMES", False);
+	netatom[NetWMDesktop] = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
 	xatom[Manager] = XInternAtom(dpy, "MANAGER", False);
 	xatom[Xembed] = XInternAtom(dpy, "_XEMBED", False);
 	xatom[XembedInfo] = XInternAtom(dpy, "_XEMBED_INFO", False);
@@ -2146,13 +4141,14 @@ setup(void)
 	cursor[CurMove] = drw_cur_create(drw, XC_fleur);
 	/* init appearance */
 	scheme = ecalloc(LENGTH(colors) + 1, sizeof(Clr *));
-	scheme[LENGTH(colors)] = drw_scm_create(drw, colors[0], 3);
+	scheme[LENGTH(colors)] = drw_scm_create(drw, cfg.colors, 3);
 	for (i = 0; i < LENGTH(colors); i++)
-		scheme[i] = drw_scm_create(drw, colors[i], 3);
+		scheme[i] = drw_scm_create(drw, &cfg.colors[i * 3], 3);
 	/* init system tray */
 	updatesystray();
 	/* init bars */
 	updatebars();
+	setupstatus();
 	updatestatus();
 	/* supporting window for NetWMCheck */
 	wmcheckwin = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
@@ -2166,17 +4162,68 @@ setup(void)
 	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
 		PropModeReplace, (unsigned char *) netatom, NetLast);
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	XDeleteProperty(dpy, root, netatom[NetClientListStacking]);
+	/* tags are desktops, their number and names are fixed */
+	XChangeProperty(dpy, root, netatom[NetNumberOfDesktops], XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *) &ndesktops, 1);
+	for (i = 0, len = 0; i < LENGTH(tags); i++)
+		len += strlen(tags[i]) + 1;
+	names = ecalloc(len, 1);
+	for (i = 0, len = 0; i < LENGTH(tags); i++)
+		len += strlen(strcpy(names + len, tags[i])) + 1;
+	XChangeProperty(dpy, root, netatom[NetDesktopNames], utf8string, 8,
+		PropModeReplace, (unsigned char *) names, len);
+	free(names);
 	/* select events */
 	wa.cursor = cursor[CurNormal]->cursor;
+	/* only what handler[] consumes, pointer motion and crossing events
+	 * would wake dwm on every mouse movement for nothing */
 	wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
-		|ButtonPressMask|PointerMotionMask|EnterWindowMask
-		|LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
+		|ButtonPressMask|StructureNotifyMask|PropertyChangeMask;
 	XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
 	XSelectInput(dpy, root, wa.event_mask);
+	updatenumlockmask();
+	regrabbuttons();
 	grabkeys();
+	if ((modetimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) >= 0)
+		watchfd(modetimer, readtimer);
+	if ((titletimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) >= 0)
+		watchfd(titletimer, readtimer);
 	focus(NULL);
 }
 
+void
+setupstatus(void)
+{
+	StatusBlock *b;
+	int i;
+
+	statusblocks = ecalloc(LENGTH(blocks), sizeof(StatusBlock));
+	for (i = 0; i < LENGTH(blocks); i++) {
+		b = &statusblocks[i];
+		b->src.kind = blocks[i].src;
+		b->src.arg = blocks[i].arg;
+		b->timer = -1;
+		if (blocks[i].src == SbExternal || !sb_open(&b->src))
+			continue;
+		if ((b->timer = watchtimer(blocks[i].interval, statustick)) < 0) {
+			sb_close(&b->src);
+			continue;
+		}
+		updateblock(b, &blocks[i]);
+	}
+	if ((statustimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) >= 0)
+		watchfd(statustimer, readtimer);
+	/* opened for writing too, so the last writer closing it is no EOF */
+	if (!runtimepath(statuspath, sizeof statuspath, ".status")
+	|| (unlink(statuspath) < 0 && errno != ENOENT)
+	|| mkfifo(statuspath, 0600) < 0
+	|| (statusfd = open(statuspath, O_RDWR|O_NONBLOCK|O_CLOEXEC)) < 0)
+		fprintf(stderr, "dwm: cannot create %s: %s\n", statuspath, strerror(errno));
+	else
+		watchfd(statusfd, readstatus);
+}
+
 void
 seturgent(Client *c, int urg)
 {
@@ -2208,21 +4255,17 @@ showhide(Client *c)
 	}
 }
 
-void
-sigchld(int unused)
-{
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("can't install SIGCHLD handler:");
-	while (0 < waitpid(-1, NULL, WNOHANG));
-}
-
 void
 spawn(const Arg *arg)
 {
+	sigset_t sm;
+
 	if (fork() == 0) {
 		if (dpy)
 			close(ConnectionNumber(dpy));
 		setsid();
+		sigemptyset(&sm);
+		sigprocmask(SIG_SETMASK, &sm, NULL);
 		execvp(((char **)arg->v)[0], (char **)arg->v);
 		die("dwm: execvp '%s' failed:", ((char **)arg->v)[0]);
 	}
@@ -2230,10 +4273,14 @@ spawn(const Arg *arg)
 
 void spawnscratch(const Arg* arg)
 {
+	sigset_t sm;
+
 	if (fork() == 0) {
 		if (dpy)
 			close(ConnectionNumber(dpy));
 		setsid();
+		sigemptyset(&sm);
+		sigprocmask(SIG_SETMASK, &sm, NULL);
 		execvp(((char**) arg->v)[1], ((char**) arg->v) + 1);
 		fprintf(stderr, "dwm: execvp %s", ((char**) arg->v)[1]);
 		perror(" failed");
@@ -2241,6 +4288,37 @@ void spawnscratch(const Arg* arg)
 	}
 }
 
+/* mirrors a raise or lower of w in the stacking order */
+void
+stackclient(Window w, int top)
+{
+	ClientList *l = &clientlist;
+	int i;
+
+	for (i = 0; i < l->n && l->stacked[i] != w; i++);
+	if (i == l->n)
+		return;
+	if (top) {
+		memmove(&l->stacked[i], &l->stacked[i + 1], (l->n - i - 1) * sizeof(Window));
+		l->stacked[l->n - 1] = w;
+	} else {
+		memmove(&l->stacked[1], &l->stacked[0], i * sizeof(Window));
+		l->stacked[0] = w;
+	}
+}
+
+void
+statustick(int fd)
+{
+	uint64_t expired;
+	int i;
+
+	while (read(fd, &expired, sizeof expired) < 0 && errno == EINTR);
+	for (i = 0; i < LENGTH(blocks); i++)
+		if (statusblocks[i].timer == fd)
+			updateblock(&statusblocks[i], &blocks[i]);
+}
+
 void
 tag(const Arg *arg)
 {
@@ -2251,6 +4329,16 @@ tag(const Arg *arg)
 	}
 }
 
+/* the first tag in t, as an EWMH desktop number */
+long
+tagdesktop(unsigned int t)
+{
+	long i;
+
+	for (i = 0; i < LENGTH(tags) && !(t >> i & 1); i++);
+	return i < LENGTH(tags) ? i : 0;
+}
+
 void
 tagmon(const Arg *arg)
 {
@@ -2426,17 +4514,7 @@ togglebar(const Arg *arg)
 	selmon->showbar = !selmon->showbar;
 	updatebarpos(selmon);
 	resizebarwin(selmon);
-	if (showsystray) {
-		XWindowChanges wc;
-		if (!selmon->showbar)
-			wc.y = -bh;
-		else if (selmon->showbar) {
-			wc.y = 0;
-			if (!selmon->topbar)
-				wc.y = selmon->mh - bh;
-		}
-		XConfigureWindow(dpy, systray->win, CWY, &wc);
-	}
+	updatesystray();
 	arrange(selmon);
 }
 
@@ -2527,14 +4605,32 @@ unfocus(Client *c, int setfocus)
 	}
 }
 
+void
+unlistclient(Window w)
+{
+	ClientList *l = &clientlist;
+	int i;
+
+	for (i = 0; i < l->n && l->mapped[i] != w; i++);
+	if (i == l->n)
+		return;
+	memmove(&l->mapped[i], &l->mapped[i + 1], (l->n - i - 1) * sizeof(Window));
+	for (i = 0; l->stacked[i] != w; i++);
+	memmove(&l->stacked[i], &l->stacked[i + 1], (l->n - i - 1) * sizeof(Window));
+	l->n--;
+	l->dirty = 1;
+}
+
 void
 unmanage(Client *c, int destroyed)
 {
 	Monitor *m = c->mon;
 	XWindowChanges wc;
+	uint32_t win = c->win;
 
 	detach(c);
 	detachstack(c);
+	unlistclient(c->win);
 	freeicon(c);
 	if (!destroyed) {
 		wc.border_width = c->oldbw;
@@ -2543,37 +4639,64 @@ unmanage(Client *c, int destroyed)
 		XSelectInput(dpy, c->win, NoEventMask);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-		setclientstate(c, WithdrawnState);
+		XDeleteProperty(dpy, c->win, netatom[NetWMDesktop]);
+		setclientstate(c->win, WithdrawnState);
 		XSync(dpy, False);
 		XSetErrorHandler(xerror);
 		XUngrabServer(dpy);
 	}
-	free(c);
+	free(c->info);
+	slab_free(&clientslab, c);
 	focus(NULL);
-	updateclientlist();
 	arrange(m);
+	/* flushstate() only sees the clients that are left */
+	if (journal && !jn_append(journal, JnGone, &win))
+		compactjournal();
 }
 
 void
 unmapnotify(XEvent *e)
 {
 	Client *c;
+	TrayIcon *i;
 	XUnmapEvent *ev = &e->xunmap;
 
 	if ((c = wintoclient(ev->window))) {
 		if (ev->send_event)
-			setclientstate(c, WithdrawnState);
+			setclientstate(c->win, WithdrawnState);
 		else
 			unmanage(c, 0);
 	}
-	else if ((c = wintosystrayicon(ev->window))) {
+	else if ((i = wintosystrayicon(ev->window))) {
 		/* KLUDGE! sometimes icons occasionally unmap their windows, but do
 		 * _not_ destroy them. We map those windows back */
-		XMapRaised(dpy, c->win);
+		XMapRaised(dpy, i->win);
 		updatesystray();
 	}
 }
 
+void
+unwatchfd(int fd)
+{
+	int i;
+
+	for (i = 0; i < nwatches && watches[i].fd != fd; i++);
+	if (i == nwatches)
+		return;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	memmove(&watches[i], &watches[i + 1], (--nwatches - i) * sizeof(Watch));
+}
+
+void
+updateblock(StatusBlock *b, const Block *def)
+{
+	char value[sizeof b->text];
+
+	if (!sb_read(&b->src, value, sizeof value))
+		value[0] = '\0';
+	setblock(b, def, value);
+}
+
 void
 updatebars(void)
 {
@@ -2652,17 +4775,46 @@ updatebarpos(Monitor *m)
 }
 
 void
-updateclientlist()
+updateclientlist(void)
+{
+	ClientList *l = &clientlist;
+
+	if (l->dirty)
+		XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32,
+			PropModeReplace, (unsigned char *) l->mapped, l->n);
+	if (l->n != l->nwritten
+	|| (l->n && memcmp(l->stacked, l->written, l->n * sizeof(Window)))) {
+		XChangeProperty(dpy, root, netatom[NetClientListStacking], XA_WINDOW, 32,
+			PropModeReplace, (unsigned char *) l->stacked, l->n);
+		memcpy(l->written, l->stacked, l->n * sizeof(Window));
+		l->nwritten = l->n;
+	}
+	l->dirty = 0;
+}
+
+/* publishes tag changes as EWMH desktops, once per batch of events */
+void
+updatedesktops(void)
 {
 	Client *c;
 	Monitor *m;
+	long d;
 
-	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	if ((d = tagdesktop(selmon->tagset[selmon->seltags])) != curdesktop) {
+		curdesktop = d;
+		XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *) &d, 1);
+	}
 	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			XChangeProperty(dpy, root, netatom[NetClientList],
-				XA_WINDOW, 32, PropModeAppend,
-				(unsigned char *) &(c->win), 1);
+		for (c = m->clients; c; c = c->next) {
+			/* clients on every tag are sticky */
+			d = (c->tags & TAGMASK) == TAGMASK ? 0xFFFFFFFF : tagdesktop(c->tags);
+			if (d == c->desktop)
+				continue;
+			c->desktop = d;
+			XChangeProperty(dpy, c->win, netatom[NetWMDesktop], XA_CARDINAL, 32,
+				PropModeReplace, (unsigned char *) &d, 1);
+		}
 }
 
 int
@@ -2750,6 +4902,29 @@ updateicon(Client *c)
 	c->icon = geticonprop(c->win, &c->icw, &c->ich);
 }
 
+/* rereads the keysyms of count keycodes from first and moves the grabs of
+ * those that changed, as after a layout switch */
+void
+updatekeycodes(int first, int count)
+{
+	int i, k, skip;
+	KeySym *syms;
+
+	first = MAX(first, minkeycode);
+	count = MIN(count, maxkeycode - first + 1);
+	if (count <= 0 || !(syms = XGetKeyboardMapping(dpy, first, count, &skip)))
+		return;
+	for (i = 0; i < count; i++) {
+		k = first + i;
+		if (syms[i * skip] == keycodesyms[k - minkeycode])
+			continue;
+		grabkey(&cfg, k, 0);
+		keycodesyms[k - minkeycode] = syms[i * skip];
+		grabkey(&cfg, k, 1);
+	}
+	XFree(syms);
+}
+
 void
 updatenumlockmask(void)
 {
@@ -2766,63 +4941,49 @@ updatenumlockmask(void)
 	XFreeModifiermap(modmap);
 }
 
+void
+updateprotocols(Client *c)
+{
+	Atom *protocols;
+	int n;
+
+	c->protocols = 0;
+	if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+		while (n--)
+			if (protocols[n] == wmatom[WMDelete])
+				c->protocols |= 1 << WMDelete;
+			else if (protocols[n] == wmatom[WMTakeFocus])
+				c->protocols |= 1 << WMTakeFocus;
+		XFree(protocols);
+	}
+}
+
 void
 updatesizehints(Client *c)
 {
-	long msize;
-	XSizeHints size;
+	SizeHints *s = &c->info->hints;
 
-	if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
-		/* size is uninitialized, ensure that size.flags aren't used */
-		size.flags = PSize;
-	if (size.flags & PBaseSize) {
-		c->basew = size.base_width;
-		c->baseh = size.base_height;
-	} else if (size.flags & PMinSize) {
-		c->basew = size.min_width;
-		c->baseh = size.min_height;
-	} else
-		c->basew = c->baseh = 0;
-	if (size.flags & PResizeInc) {
-		c->incw = size.width_inc;
-		c->inch = size.height_inc;
-	} else
-		c->incw = c->inch = 0;
-	if (size.flags & PMaxSize) {
-		c->maxw = size.max_width;
-		c->maxh = size.max_height;
-	} else
-		c->maxw = c->maxh = 0;
-	if (size.flags & PMinSize) {
-		c->minw = size.min_width;
-		c->minh = size.min_height;
-	} else if (size.flags & PBaseSize) {
-		c->minw = size.base_width;
-		c->minh = size.base_height;
-	} else
-		c->minw = c->minh = 0;
-	if (size.flags & PAspect) {
-		c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-		c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
-	} else
-		c->maxa = c->mina = 0.0;
-	c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
-	c->hintsvalid = 1;
+	getsizehints(c->win, s);
+	c->isfixed = (s->maxw && s->maxh && s->maxw == s->minw && s->maxh == s->minh);
+	c->info->hintsvalid = 1;
 }
 
 void
 updatestatus(void)
 {
-	if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
-		strcpy(stext, "dwm-"VERSION);
-	drawbar(selmon);
-	updatesystray();
+	if (!gettextprop(root, XA_WM_NAME, rootname, sizeof(rootname)))
+		rootname[0] = '\0';
+	statusdirty = 1;
 }
 
 void
-updatesystrayicongeom(Client *i, int w, int h)
+updatesystrayicongeom(TrayIcon *i, int w, int h)
 {
+	int ow, oh;
+
 	if (i) {
+		ow = i->w;
+		oh = i->h;
 		i->h = bh;
 		if (w == h)
 			i->w = bh;
@@ -2830,7 +4991,8 @@ updatesystrayicongeom(Client *i, int w, int h)
 			i->w = w;
 		else
 			i->w = (int) ((float)bh * ((float)w / (float)h));
-		applysizehints(i, &(i->x), &(i->y), &(i->w), &(i->h), False);
+		i->w = MAX(i->w, bh);
+		applyhints(&i->hints, &i->w, &i->h);
 		/* force icons into the systray dimensions if they don't want to */
 		if (i->h > bh) {
 			if (i->w == i->h)
@@ -2839,30 +5001,34 @@ updatesystrayicongeom(Client *i, int w, int h)
 				i->w = (int) ((float)bh * ((float)i->w / (float)i->h));
 			i->h = bh;
 		}
+		if (i->w != ow || i->h != oh) {
+			i->dirty = 1;
+			systray->w = 0;
+		}
 	}
 }
 
 void
-updatesystrayiconstate(Client *i, XPropertyEvent *ev)
+updatesystrayiconstate(TrayIcon *i, XPropertyEvent *ev)
 {
 	long flags;
 	int code = 0;
 
 	if (!showsystray || !i || ev->atom != xatom[XembedInfo] ||
-			!(flags = getatomprop(i, xatom[XembedInfo])))
+			!(flags = getatomprop(i->win, xatom[XembedInfo])))
 		return;
 
-	if (flags & XEMBED_MAPPED && !i->tags) {
-		i->tags = 1;
+	if (flags & XEMBED_MAPPED && !i->mapped) {
+		i->mapped = 1;
 		code = XEMBED_WINDOW_ACTIVATE;
 		XMapRaised(dpy, i->win);
-		setclientstate(i, NormalState);
+		setclientstate(i->win, NormalState);
 	}
-	else if (!(flags & XEMBED_MAPPED) && i->tags) {
-		i->tags = 0;
+	else if (!(flags & XEMBED_MAPPED) && i->mapped) {
+		i->mapped = 0;
 		code = XEMBED_WINDOW_DEACTIVATE;
 		XUnmapWindow(dpy, i->win);
-		setclientstate(i, WithdrawnState);
+		setclientstate(i->win, WithdrawnState);
 	}
 	else
 		return;
@@ -2870,26 +5036,27 @@ updatesystrayiconstate(Client *i, XPropertyEvent *ev)
 			systray->win, XEMBED_EMBEDDED_VERSION);
 }
 
+/* places icons that are new, resized or shifted by one that is, and the
+ * window only when its geometry or monitor changed */
 void
 updatesystray(void)
 {
 	XSetWindowAttributes wa;
 	XWindowChanges wc;
-	Client *i;
+	TrayIcon *i;
 	Monitor *m = systraytomon(NULL);
-	unsigned int x = m->mx + m->mw;
-	unsigned int sw = TEXTW(stext) - lrpad + systrayspacing;
-	unsigned int w = 1;
+	int x = m->mx + m->mw;
+	unsigned int w;
 
 	if (!showsystray)
 		return;
 	if (systrayonleft)
-		x -= sw + lrpad / 2;
+		x -= TEXTW(stext) - lrpad + systrayspacing + lrpad / 2;
 	if (!systray) {
 		/* init systray */
 		if (!(systray = (Systray *)calloc(1, sizeof(Systray))))
 			die("fatal: could not malloc() %u bytes\n", sizeof(Systray));
-		systray->win = XCreateSimpleWindow(dpy, root, x, m->by, w, bh, 0, 0, scheme[SchemeSel][ColBg].pixel);
+		systray->win = XCreateSimpleWindow(dpy, root, x, m->by, 1, bh, 0, 0, scheme[SchemeSel][ColBg].pixel);
 		wa.event_mask        = ButtonPressMask | ExposureMask;
 		wa.override_redirect = True;
 		wa.background_pixel  = scheme[SchemeNorm][ColBg].pixel;
@@ -2909,47 +5076,64 @@ updatesystray(void)
 			systray = NULL;
 			return;
 		}
+		systray->dirty = 1;
 	}
 	for (w = 0, i = systray->icons; i; i = i->next) {
-		/* make sure the background color stays the same */
-		wa.background_pixel  = scheme[SchemeNorm][ColBg].pixel;
-		XChangeWindowAttributes(dpy, i->win, CWBackPixel, &wa);
-		XMapRaised(dpy, i->win);
 		w += systrayspacing;
-		i->x = w;
-		XMoveResizeWindow(dpy, i->win, i->x, 0, i->w, i->h);
+		if (systray->dirty || i->dirty || i->x != w) {
+			/* make sure the background color stays the same */
+			wa.background_pixel  = scheme[SchemeNorm][ColBg].pixel;
+			XChangeWindowAttributes(dpy, i->win, CWBackPixel, &wa);
+			if (i->mapped)
+				XMapRaised(dpy, i->win);
+			i->x = w;
+			XMoveResizeWindow(dpy, i->win, i->x, 0, i->w, i->h);
+			i->dirty = 0;
+		}
 		w += i->w;
-		if (i->mon != m)
-			i->mon = m;
 	}
-	w = w ? w + systrayspacing : 1;
+	w = getsystraywidth();
 	x -= w;
-	XMoveResizeWindow(dpy, systray->win, x, m->by, w, bh);
+	if (!systray->dirty && systray->mon == m && systray->wx == x
+	&& systray->wy == m->by && systray->ww == w)
+		return;
 	wc.x = x; wc.y = m->by; wc.width = w; wc.height = bh;
 	wc.stack_mode = Above; wc.sibling = m->barwin;
 	XConfigureWindow(dpy, systray->win, CWX|CWY|CWWidth|CWHeight|CWSibling|CWStackMode, &wc);
 	XMapWindow(dpy, systray->win);
-	XMapSubwindows(dpy, systray->win);
-	/* redraw background */
-	XSetForeground(dpy, drw->gc, scheme[SchemeNorm][ColBg].pixel);
-	XFillRectangle(dpy, systray->win, drw->gc, 0, 0, w, bh);
-	XSync(dpy, False);
+	systray->mon = m;
+	systray->wx = x;
+	systray->wy = m->by;
+	systray->ww = w;
+	systray->dirty = 0;
+	drawsystray();
 }
 
 void
 updatetitle(Client *c)
 {
-	if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-		gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-	if (c->name[0] == '\0') /* hack to mark broken clients */
-		strcpy(c->name, broken);
+	ClientInfo *in = c->info;
+
+	for (;;) {
+		if (!gettextprop(c->win, netatom[NetWMName], in->name, in->namesize))
+			gettextprop(c->win, XA_WM_NAME, in->name, in->namesize);
+		/* a title this close to the end may have been cut, along with a
+		 * partial UTF-8 sequence, so grow to the full 256 bytes and reread */
+		if (in->namesize >= 256 || strlen(in->name) + 4 < in->namesize)
+			break;
+		in->namesize = 256;
+		c->info = in = erealloc(in, sizeof(ClientInfo) + in->namesize);
+	}
+	if (in->name[0] == '\0') /* hack to mark broken clients */
+		strcpy(in->name, broken);
+	c->titlechanged = 1;
 }
 
 void
 updatewindowtype(Client *c)
 {
-	Atom state = getatomprop(c, netatom[NetWMState]);
-	Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
+	Atom state = getatomprop(c->win, netatom[NetWMState]);
+	Atom wtype = getatomprop(c->win, netatom[NetWMWindowType]);
 
 	if (state == netatom[NetWMFullscreen])
 		setfullscreen(c, 1);
@@ -2988,6 +5172,52 @@ view(const Arg *arg)
 	arrange(selmon);
 }
 
+void
+watchfd(int fd, void (*func)(int))
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		die("dwm: epoll_ctl:");
+	watches = erealloc(watches, (nwatches + 1) * sizeof(Watch));
+	watches[nwatches].fd = fd;
+	watches[nwatches].out = 0;
+	watches[nwatches++].func = func;
+}
+
+void
+watchout(int fd, int on)
+{
+	struct epoll_event ev = { .data.fd = fd };
+	int i;
+
+	for (i = 0; i < nwatches && watches[i].fd != fd; i++);
+	if (i == nwatches || watches[i].out == on)
+		return;
+	ev.events = on ? EPOLLIN|EPOLLOUT : EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+		watches[i].out = on;
+}
+
+/* calls func every ms milliseconds, returns the timerfd or -1 */
+int
+watchtimer(unsigned int ms, void (*func)(int))
+{
+	struct itimerspec its;
+	int fd;
+
+	if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+		return -1;
+	its.it_value.tv_sec = its.it_interval.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = its.it_interval.tv_nsec = ms % 1000 * 1000000;
+	if (!ms || timerfd_settime(fd, 0, &its, NULL) < 0) {
+		close(fd);
+		return -1;
+	}
+	watchfd(fd, func);
+	return fd;
+}
+
 Client *
 wintoclient(Window w)
 {
@@ -3001,9 +5231,9 @@ wintoclient(Window w)
 	return NULL;
 }
 
-Client *
+TrayIcon *
 wintosystrayicon(Window w) {
-	Client *i = NULL;
+	TrayIcon *i = NULL;
 
 	if (!showsystray || !w)
 		return i;
@@ -3120,8 +5350,27 @@ main(int argc, char *argv[])
 	if (pledge("stdio rpath proc exec", NULL) == -1)
 		die("pledge");
 #endif /* __OpenBSD__ */
+	loadstate();
 	scan();
+	applystate();
+	compactjournal();
 	run();
+	if (restarting) {
+		/* the new image picks every window up where this one leaves it;
+		 * closing the connection first releases SubstructureRedirect, so
+		 * its checkotherwm() does not race the server noticing an exit */
+		savestate();
+		XCloseDisplay(dpy);
+		execvp(argv[0], argv);
+		fprintf(stderr, "dwm: cannot restart, execvp '%s': %s\n", argv[0], strerror(errno));
+		/* the windows stay as they are, the next dwm recovers them from the
+		 * journal */
+		if ((dpy = XOpenDisplay(NULL))) {
+			XDeleteProperty(dpy, root, wmatom[DwmState]);
+			XCloseDisplay(dpy);
+		}
+		return EXIT_FAILURE;
+	}
 	cleanup();
 	XCloseDisplay(dpy);
 	return EXIT_SUCCESS;
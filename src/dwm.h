@@ -28,6 +28,12 @@
 #include <stdint.h>
 
 #include "drw.h"
+#include "ipc.h"
+#include "journal.h"
+#include "rules.h"
+#include "state.h"
+#include "status.h"
+#include "util.h"
 
 // Macros {{{
 #define BUTTONMASK (ButtonPressMask | ButtonReleaseMask)
@@ -42,6 +48,7 @@
 #define ICONSIZE    16
 #define ICONSPACING 5
 #define ISVISIBLE(C) ((C->tags & C->mon->tagset[C->mon->seltags]))
+#define JSONBOOL(X) ((X) ? "true" : "false")
 #define LENGTH(X) (sizeof X / sizeof X[0])
 #define MAXTABS 50
 #define MODKEY Mod4Mask
@@ -73,6 +80,7 @@
 // Enums {{{
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel };                  /* color schemes */
+enum { GrabNone, GrabFocused, GrabUnfocused };   /* client button grabs */
 enum {
 	NetSupported,
 	NetWMName,
@@ -88,6 +96,11 @@ enum {
 	NetWMWindowType,
 	NetWMWindowTypeDialog,
 	NetClientList,
+	NetClientListStacking,
+	NetNumberOfDesktops,
+	NetCurrentDesktop,
+	NetDesktopNames,
+	NetWMDesktop,
 	NetLast
 }; /* EWMH atoms */
 enum {
@@ -101,6 +114,8 @@ enum {
 	WMDelete,
 	WMState,
 	WMTakeFocus,
+	DwmState,
+	DwmSession,
 	WMLast
 }; /* default atoms */
 enum {
@@ -114,6 +129,26 @@ enum {
 	ClkRootWin,
 	ClkLast
 }; /* clicks */
+enum {
+	ArgNone,
+	ArgInt,
+	ArgTag,
+	ArgFloat,
+	ArgCmd,
+	ArgLayout,
+	ArgScratch,
+	ArgMode
+}; /* how a config file argument is parsed */
+enum {
+	BatchTag,
+	BatchMonitor,
+	BatchFloat,
+	BatchResize,
+	BatchLayout,
+	BatchMfact,
+	BatchNmaster,
+	BatchView
+}; /* operations of an IPC batch */
 enum showtab_modes {
 	showtab_never,
 	showtab_auto,
@@ -135,38 +170,123 @@ typedef struct {
 	unsigned int mask;
 	unsigned int button;
 	void (*func)(const Arg* arg);
-	const Arg arg;
+	Arg          arg;
 } Button;
 
+/* a ClkClientWin button with one of the lock modifier combinations */
+typedef struct {
+	unsigned int button;
+	unsigned int mask;
+} ButtonGrab;
+
+/* WM_NORMAL_HINTS, as far as dwm applies them */
+typedef struct {
+	float mina, maxa;
+	int   basew, baseh, incw, inch, maxw, maxh, minw, minh;
+} SizeHints;
+
+/* the parts of a client only read when it is retitled, resized or drawn */
+typedef struct {
+	SizeHints hints;
+	int       hintsvalid;
+	long long titleread; /* when, in ms */
+	size_t    namesize;  /* room in name, at most 256 */
+	char      name[];
+} ClientInfo;
+
 typedef struct Monitor Monitor;
 typedef struct Client  Client;
+/* What layouts and ISVISIBLE read of every client comes first, the rest
+ * after it and in info. Clients come from clientslab. */
 struct Client {
-	char         name[256];
-	float        mina, maxa;
+	Client*      next;
+	Client*      snext;
+	Monitor*     mon;
+	Window       win;
+	unsigned int tags;
+	int          isfloating, isfullscreen;
 	int          x, y, w, h;
+	int          bw;
+	int          isfixed, isurgent, neverfocus, oldstate;
+	int          oldbw;
 	int          sfx, sfy, sfw, sfh;
 	int          oldx, oldy, oldw, oldh;
-	int          basew, baseh, incw, inch, maxw, maxh, minw, minh, hintsvalid;
-	int          bw, oldbw;
-	unsigned int tags;
-	int          isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen;
+	unsigned int protocols; /* 1 << WMDelete, WMTakeFocus if in WM_PROTOCOLS */
+	int          grabbed;   /* the button grabs in place */
 	int          floatborderpx;
 	int          hasfloatbw;
-	unsigned int icw, ich; Picture icon;
+	int          titlechanged; /* since the last IPC events */
+	int          titlestale;   /* changed since it was last read */
 	char         scratchkey;
-	Client*      next;
-	Client*      snext;
-	Monitor*     mon;
-	Window       win;
+	long         desktop;  /* _NET_WM_DESKTOP as last written, -2 if never */
+	ClientState  js;       /* as last journaled */
+	uint32_t     stackpos; /* set by numberstack() */
+	unsigned int icw, ich; Picture icon;
+	ClientInfo*  info;
 };
 
+/* what IPC subscribers last heard about a monitor */
+typedef struct {
+	unsigned int tags, occ, urg;
+	char         ltsymbol[16];
+} IpcSeen;
+
+typedef struct {
+	const char* name;
+	void (*func)(IpcConn* c, char* args);
+} IpcRequest;
+
+typedef struct {
+	const char* name;
+	int         onclient; /* addressed by window id, else by monitor number */
+	int         argtype;
+} BatchDef;
+
+/* one operation of an IPC batch, checked before any is applied */
+typedef struct {
+	int      op;
+	Client*  c;
+	Monitor* m;
+	Monitor* from; /* monitor the operation changed, besides m */
+	Arg      arg;
+	int      x, y, w, h;
+} BatchOp;
+
 typedef struct {
 	unsigned int mod;
 	KeySym       keysym;
 	void (*func)(const Arg*);
-	const Arg arg;
+	Arg          arg;
+	unsigned int mode; /* keymodes[] index, 0 for keys grabbed on the root */
 } Key;
 
+/* a keymap entered by keymode(), with the keyboard grabbed. Keys bound to
+ * keymode() lead from one to another, so chords form a trie. */
+typedef struct {
+	const char* name;
+	int         sticky; /* stays after a key until left, no timeout */
+} KeyMode;
+
+typedef struct {
+	const char* name;
+	void (*func)(const Arg*);
+	int argtype;
+} Command;
+
+/* bindings and appearance in effect, dwm.h plus the config file */
+typedef struct {
+	Key*         keys;     /* by mode, keysym and mod */
+	unsigned int nkeys;
+	Button*      buttons;
+	unsigned int nbuttons;
+	const char** fonts;
+	unsigned int nfonts;
+	int          deffonts; /* fonts still point to fonts[] */
+	const char** colors;   /* 3 per scheme, laid out as colors[] */
+	void**       mem;      /* strings and argv arrays read from the file */
+	unsigned int nmem;
+} Config;
+
 typedef struct {
 	const char* symbol;
 	void (*arrange)(Monitor*);
@@ -198,6 +318,8 @@ struct Monitor {
 	int           ntabs;
 	int           tab_widths[MAXTABS];
 	const Layout* lt[2];
+	MonState      js; /* as last journaled */
+	IpcSeen       seen;
 };
 
 typedef struct {
@@ -212,16 +334,74 @@ typedef struct {
 	const char   scratchkey;
 } Rule;
 
+typedef struct {
+	int fd;
+	int out; /* also woken when writable */
+	void (*func)(int fd);
+} Watch;
+
+typedef struct {
+	int          src;      /* one of the Sb sources of status.h */
+	const char*  arg;      /* the block's name for SbExternal */
+	const char*  fmt;      /* the value replaces %s */
+	unsigned int interval; /* in milliseconds */
+} Block;
+
+typedef struct {
+	StatusSrc src;
+	int       timer; /* -1 if the source is unavailable */
+	char      text[64];
+} StatusBlock;
+
+/* a spawned command whose output is collected through the event loop, more
+ * than fits in out is read and dropped */
+typedef struct Helper Helper;
+struct Helper {
+	int     fd;
+	char    out[256];
+	size_t  len;
+	void (*done)(char* out);
+	Helper* next;
+};
+
+/* _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING, written once per batch of
+ * events */
+typedef struct {
+	Window* mapped;  /* in mapping order */
+	Window* stacked; /* bottom to top */
+	Window* written; /* stacked as last written */
+	int     n, nwritten, cap;
+	int     dirty;   /* mapped changed since the last write */
+} ClientList;
+
+/* an XEMBED client docked in the systray */
+typedef struct TrayIcon TrayIcon;
+struct TrayIcon {
+	Window    win;
+	int       x, w, h;
+	int       mapped; /* as XEMBED_MAPPED last said */
+	int       dirty;  /* to be placed again */
+	SizeHints hints;
+	TrayIcon* next;
+};
+
 typedef struct Systray Systray;
 struct Systray {
-	Window win;
-	Client *icons;
+	Window       win;
+	TrayIcon*    icons;
+	unsigned int w;          /* of icons and spacing, 0 until computed */
+	int          wx, wy, ww; /* window geometry as last configured */
+	Monitor*     mon;
+	int          dirty;      /* place every icon and the window again */
 };
 // }}}
 // }}}
 
 // Functions {{{
+static void         applybatch(BatchOp* o);
+static void         applyhints(const SizeHints* s, int* w, int* h);
 static void         applyrules(Client* c);
+static void         applystate(void);
 static int          applysizehints(Client* c, int* x, int* y, int* w, int* h, int interact);
 static void         arrange(Monitor* m);
 static void         arrangemon(Monitor* m);
@@ -235,12 +415,20 @@ static void         centeredfloatingmaster(Monitor *m);
 static void         checkotherwm(void);
 static void         cleanup(void);
 static void         cleanupmon(Monitor* mon);
+static void         collectstate(SavedState* st);
+static void         compactjournal(void);
 static void         clientmessage(XEvent* e);
 static int          cmpint(const void *p1, const void *p2);
+static void         configchanged(int fd);
+static void*        configown(Config* c, void* p);
+static int          configpath(char* buf, size_t size, const char* name);
+static char*        configstr(Config* c, const char* s);
+static char*        configword(char** s);
 static void         configure(Client* c);
 static void         configurenotify(XEvent* e);
 static void         configurerequest(XEvent* e);
 static Monitor*     createmon(void);
+static void         defaultconfig(Config* c);
 static void         cyclelayout(const Arg *arg);
 static void         deck(Monitor *m);
 static void         destroynotify(XEvent* e);
@@ -249,66 +437,125 @@ static void         detachstack(Client* c);
 static Monitor*     dirtomon(int dir);
 static void         drawbar(Monitor* m);
 static void         drawbars(void);
+static void         drawsystray(void);
 static void         drawtab(Monitor *m);
 static void         drawtabs(void);
 static int          drawstatusbar(Monitor *m, int bh, char* text);
 static void         expose(XEvent* e);
+static void         fillclientstate(Client* c, ClientState* cs, uint32_t pos);
+static void         fillmonstate(Monitor* m, MonState* ms);
+static unsigned int findkey(const Config* c, unsigned int mode, KeySym sym);
+static void         flushevents(void);
+static void         flushstate(void);
+static void         flushstatus(void);
+static void         flushtitles(void);
 static void         focus(Client* c);
 static void         focusin(XEvent* e);
 static void         focusmaster(const Arg *arg);
 static void         focusmon(const Arg* arg);
 static void         focusstack(const Arg* arg);
 static void         focuswin(const Arg* arg);
+static void         foldrepeats(void (*func)(const Arg*), Arg* arg, XKeyEvent* ev);
+static void         freeconfig(Config* c);
 static void         freeicon(Client *c);
-static Atom         getatomprop(Client* c, Atom prop);
+static const Command* getcommand(const char* name);
+static Atom         getatomprop(Window w, Atom prop);
 static Picture      geticonprop(Window w, unsigned int *icw, unsigned int *ich);
 static int          getrootptr(int* x, int* y);
+static void         getsizehints(Window w, SizeHints* s);
 static long         getstate(Window w);
 static unsigned int getsystraywidth();
 static int          gettextprop(Window w, Atom atom, char* text, unsigned int size);
 static void         grabbuttons(Client* c, int focused);
+static void         grabkey(const Config* c, int code, int grab);
 static void         grabkeys(void);
 static void         incnmaster(const Arg* arg);
+static void         ipcaccept(int fd);
+static void         ipcbatch(IpcConn* c, char* args);
+static void         ipcclients(IpcConn* c, char* args);
+static void         ipcdrop(IpcConn* c);
+static void         ipcflush(IpcConn* c);
+static void         ipcfocus(IpcConn* c, char* args);
+static void         ipclayouts(IpcConn* c, char* args);
+static void         ipcmonitors(IpcConn* c, char* args);
+static void         ipcnotify(void);
+static void         ipcread(int fd);
+static void         ipcrequest(IpcConn* c, char* line);
+static void         ipcrun(IpcConn* c, char* args);
+static void         ipcsubscribe(IpcConn* c, char* args);
+static void         ipctags(IpcConn* c, char* args);
+static int          keycmp(const Key* a, const Key* b);
+static void         keymode(const Arg* arg);
 static void         keypress(XEvent* e);
 static void         killclient(const Arg* arg);
+static void         layoutchosen(char* out);
 static void         layoutmenu(const Arg *arg);
+static void         listclient(Window w);
+static void         loadrules(void);
+static void         loadstate(void);
 static void         manage(Window w, XWindowAttributes* wa);
 static void         mappingnotify(XEvent* e);
 static void         maprequest(XEvent* e);
 static void         monocle(Monitor* m);
+static void         montags(Monitor* m, unsigned int* occ, unsigned int* urg);
 static void         movemouse(const Arg* arg);
 static void         movestack(const Arg* arg);
+static long long    nowms(void);
 static Client*      nexttiled(Client* c);
+static void         numberstack(Monitor* m);
 static void         pop(Client* c);
+static int          parsearg(Config* c, int type, char* s, Arg* arg);
+static const char*  parsebatch(BatchOp* o, char* s);
+static int          parseconfig(Config* c, char* line);
+static int          parsemods(char* s, unsigned int* mask);
 static uint32_t     prealpha(uint32_t p);
 static void         propertynotify(XEvent* e);
+static void         queueevent(XEvent* ev);
 static void         quit(const Arg* arg);
+static int          readconfig(Config* c);
+static void         readhelper(int fd);
+static void         readsignal(int fd);
+static void         readstatus(int fd);
+static void         readtimer(int fd);
 static Monitor*     recttomon(int x, int y, int w, int h);
-static void         removesystrayicon(Client *i);
+static void         regrabbuttons(void);
+static void         regrabkeys(const Config* old, const Config* new);
+static void         reloadconfig(void);
+static void         removesystrayicon(TrayIcon *i);
 static void         resize(Client* c, int x, int y, int w, int h, int interact);
 static void         resizebarwin(Monitor *m);
 static void         resizeclient(Client* c, int x, int y, int w, int h);
 static void         resizemouse(const Arg* arg);
 static void         resizerequest(XEvent *e);
+static void         restart(const Arg* arg);
 static void         restack(Monitor* m);
 static void         run(void);
+static void         runhelper(const char* cmd, void (*done)(char* out));
+static int          runtimepath(char* buf, size_t size, const char* suffix);
+static void         savestate(void);
 static void         scan(void);
-static int          sendevent(Window w, Atom proto, int m, long d0, long d1, long d2, long d3, long d4);
+static void         sendevent(Window w, Atom type, int m, long d0, long d1, long d2, long d3, long d4);
 static void         sendmon(Client* c, Monitor* m);
-static void         setclientstate(Client* c, long state);
+static int          sendprotocol(Client* c, int proto);
+static void         setclientstate(Window w, long state);
 static void         setfocus(Client* c);
 static void         setfullscreen(Client* c, int fullscreen);
 static void         setlayout(const Arg* arg);
 static void         setmfact(const Arg* arg);
+static int          settimer(int fd, long long ms);
+static void         setblock(StatusBlock* b, const Block* def, const char* value);
 static void         setup(void);
+static void         setupstatus(void);
 static void         seturgent(Client* c, int urg);
 static void         showhide(Client* c);
-static void         sigchld(int unused);
 static void         spawn(const Arg* arg);
+static void         stackclient(Window w, int top);
+static void         statustick(int fd);
 static void         spawnscratch(const Arg *arg);
 static Monitor*     systraytomon(Monitor *m);
 static void         tabmode(const Arg *arg);
 static void         tag(const Arg* arg);
+static long         tagdesktop(unsigned int t);
 static void         tagmon(const Arg* arg);
 static void         tatami(Monitor *m);
 static void         tile(Monitor* m);
@@ -318,26 +565,35 @@ static void         togglescratch(const Arg *arg);
 static void         toggletag(const Arg* arg);
 static void         toggleview(const Arg* arg);
 static void         unfocus(Client* c, int setfocus);
+static void         unlistclient(Window w);
 static void         unmanage(Client* c, int destroyed);
 static void         unmapnotify(XEvent* e);
+static void         unwatchfd(int fd);
 static void         updatebarpos(Monitor* m);
+static void         updateblock(StatusBlock* b, const Block* def);
 static void         updatebars(void);
 static void         updateclientlist(void);
+static void         updatedesktops(void);
 static int          updategeom(void);
 static void         updateicon(Client *c);
+static void         updatekeycodes(int first, int count);
 static void         updatenumlockmask(void);
+static void         updateprotocols(Client* c);
 static void         updatesizehints(Client* c);
 static void         updatestatus(void);
 static void         updatesystray(void);
-static void         updatesystrayicongeom(Client *i, int w, int h);
-static void         updatesystrayiconstate(Client *i, XPropertyEvent *ev);
+static void         updatesystrayicongeom(TrayIcon *i, int w, int h);
+static void         updatesystrayiconstate(TrayIcon *i, XPropertyEvent *ev);
 static void         updatetitle(Client* c);
 static void         updatewindowtype(Client* c);
 static void         updatewmhints(Client* c);
 static void         view(const Arg* arg);
+static void         watchfd(int fd, void (*func)(int));
+static void         watchout(int fd, int on);
+static int          watchtimer(unsigned int ms, void (*func)(int));
 static Client*      wintoclient(Window w);
 static Monitor*     wintomon(Window w);
-static Client*      wintosystrayicon(Window w);
+static TrayIcon*    wintosystrayicon(Window w);
 static int          xerror(Display* dpy, XErrorEvent* ee);
 static int          xerrordummy(Display* dpy, XErrorEvent* ee);
 static int          xerrorstart(Display* dpy, XErrorEvent* ee);
@@ -347,13 +603,35 @@ static void         zoom(const Arg* arg);
 // Variables {{{
 static const char broken[] = "broken";
 static char       stext[1024];
+static char       rootname[sizeof stext]; /* set by xsetroot(1), shown before the blocks */
+static StatusBlock* statusblocks;
+static int        statusdirty;
+static int        statusfd = -1;      /* the FIFO external blocks are written to */
+static char       statuspath[PATH_MAX];
+static char       statusin[1024];     /* a partial line read from it */
+static size_t     statusinlen;
+static int        statustimer = -1;   /* wakes a redraw held back by statusdelay */
+static int        statuswait;
+static long long  statusdrawn;        /* when, in ms */
 static int        screen;
 static int        sw, sh; /* X display screen geometry width, height */
 static int        bh;     /* bar height */
 static int        th = 0; /* tab bar geometry */
 static int        lrpad;  /* sum of left and right padding for text */
 static int (*xerrorxlib)(Display*, XErrorEvent*);
-static unsigned int numlockmask            = 0;
+static unsigned int numlockmask            = 0; /* as of the last MappingNotify */
+static ButtonGrab*  buttongrabs;
+static unsigned int nbuttongrabs;
+static KeySym*      keycodesyms; /* the first keysym of each keycode, as grabbed */
+static int          minkeycode, maxkeycode;
+static unsigned int curmode;     /* keymodes[] index */
+static int          modetimer = -1; /* ends a chord left unfinished */
+static int          titletimer = -1; /* brings back titles held back by titledelay */
+static int          titlesdirty;
+static XEvent*      pending;     /* structural events read behind input */
+static unsigned int npending, pendingcap;
+static XEvent*      deferred;    /* property and expose updates, one per window and atom */
+static unsigned int ndeferred, deferredcap;
 static void (*handler[LASTEvent])(XEvent*) = {
 	[ButtonPress]      = buttonpress,
 	[ClientMessage]    = clientmessage,
@@ -369,15 +647,58 @@ static void (*handler[LASTEvent])(XEvent*) = {
 	[ResizeRequest] = resizerequest,
 	[UnmapNotify]      = unmapnotify
 };
+static const IpcRequest ipcrequests[] = {
+	{ "batch",     ipcbatch },
+	{ "clients",   ipcclients },
+	{ "focus",     ipcfocus },
+	{ "layouts",   ipclayouts },
+	{ "monitors",  ipcmonitors },
+	{ "run",       ipcrun },
+	{ "subscribe", ipcsubscribe },
+	{ "tags",      ipctags },
+};
+static const BatchDef batchops[] = {
+	[BatchTag]     = { "tag",     1, ArgTag },
+	[BatchMonitor] = { "monitor", 1, ArgInt },
+	[BatchFloat]   = { "float",   1, ArgInt },
+	[BatchResize]  = { "resize",  1, ArgNone }, /* x y w h */
+	[BatchLayout]  = { "layout",  0, ArgLayout },
+	[BatchMfact]   = { "mfact",   0, ArgFloat },
+	[BatchNmaster] = { "nmaster", 0, ArgInt },
+	[BatchView]    = { "view",    0, ArgTag },
+};
 static Atom     wmatom[WMLast], netatom[NetLast], xatom[XLast];
+static Atom     utf8string;
 static int      running = 1;
+static int      restarting = 0;
+static SavedState* restoring; /* state left by the previous instance */
+static Journal* journal;
+static char     journalpath[PATH_MAX];
+static int      journalsel = -1; /* selmon as last journaled */
+static uint32_t session;         /* _DWM_SESSION, the X server journals are for */
+static long     curdesktop = -1; /* _NET_CURRENT_DESKTOP as last written */
+static int      ipcfd = -1;
+static char     ipcpath[PATH_MAX];
+static Window   ipcsel; /* focus as last sent to IPC subscribers */
+static int      deferdraw; /* bars are redrawn once at the end of a batch */
 static Cur*     cursor[CurLast];
 static Clr**    scheme;
 static Display* dpy;
 static Drw*     drw;
 static Monitor *mons, *selmon;
+static RuleIndex* ruleindex;
+static Watch*     watches;
+static int        nwatches;
+static int        inotifyfd = -1;
+static int        sigfd = -1;
+static int        epfd = -1;
+static Helper*    helpers;
+static Config     cfg;
+static ClientList clientlist;
 static Window   root, wmcheckwin;
 static Systray* systray = NULL;
+static Slab     trayslab   = SLAB(TrayIcon, 16);
+static Slab     clientslab = SLAB(Client, 64);
 // }}}
 
 // Configuration {{{
@@ -393,6 +714,12 @@ static const unsigned int systrayspacing = 1;
 // 1: if pinning fails, display systray on the first monitor, False: display systray on the last monitor
 static const int systraypinningfailfirst = 1;
 static const int showsystray = 1;
+// Titles changing faster are read and drawn once per delay, in ms
+static const unsigned int titledelay    = 500;
+static const unsigned int seltitledelay = 100; /* of the focused window */
+// Runtime files, looked up in $XDG_CONFIG_HOME/dwm (~/.config/dwm)
+static const char rulesfile[]  = "rules.db"; /* compiled by dwmrules(1) */
+static const char configfile[] = "dwmrc";    /* keys, buttons, fonts, colors */
 // Fonts
 static const char* fonts[]  = {
 	"Operator Mono Lig Book:size=9.0",
@@ -411,6 +738,22 @@ static const char* colors[][3] = {
 	[SchemeSel]  = { self_fg, self_bg, self_bd },
 };
 // }}}
+// Status {{{
+// Built-in blocks, drawn after the root window name. Sources missing on this
+// machine are left out. fmt may use the ^c#rrggbb^, ^b#rrggbb^ and ^d^ codes.
+// SbExternal blocks are set by other programs through the status FIFO.
+static const unsigned int statusdelay = 50; /* least ms between two redraws */
+static const Block blocks[] = {
+	/* source     arg               fmt                        interval */
+	{ SbExternal, "music",          "%s  ",                    0 },
+	{ SbCpu,      NULL,             "^c#268bd2^cpu^d^ %s  ",   2000 },
+	{ SbMemory,   NULL,             "^c#268bd2^mem^d^ %s  ",   5000 },
+	{ SbLoad,     NULL,             "^c#268bd2^load^d^ %s  ",  10000 },
+	{ SbNetwork,  "wlan0",          "%s  ",                    2000 },
+	{ SbBattery,  "BAT0",           "^c#268bd2^bat^d^ %s  ",   30000 },
+	{ SbClock,    "%a %d %b %H:%M", "%s",                      1000 },
+};
+// }}}
 // Tags and Rules {{{
 static const char *tags[] = { "α", "β", "ξ", "δ", "ε", "φ", "γ", "θ", "ι" };
 /* compile-time check if all tags fit into an unsigned int bit array. */
@@ -487,6 +830,17 @@ static const char *kimuxcmd[]   = { "x", TERMINAL, "--title", "kimux",   "-e", "
 static const char *cmuscmd[]    = { "m", TERMINAL, "--title", "cmus",    "-e", "cmus", NULL };
 static const char *ncmpcppcmd[] = { "n", TERMINAL, "--title", "ncmpcpp", "-e", "ncmpcpp", NULL };
 
+/* a chord is a key bound to keymode() followed by one bound in that mode, a
+ * sticky mode runs keys until one of them returns to ModeRoot */
+enum { ModeRoot, ModeLaunch, ModeResize };
+static const KeyMode keymodes[] = {
+	/* name       sticky */
+	[ModeRoot]   = { "root",   0 },
+	[ModeLaunch] = { "launch", 0 },
+	[ModeResize] = { "resize", 1 },
+};
+static const unsigned int chordtimeout = 1000; /* ms to wait for the next key */
+
 static const Key keys[] = {
 	/* modifier                     key        function        argument */
 	// Left Side {{{
@@ -497,6 +851,7 @@ static const Key keys[] = {
 	{ MODKEY|ShiftMask,             XK_e, tagmon,         { .i = +1 } },
 	{ MODKEY,                       XK_r, view,           { 0 } },
 	{ MODKEY|ShiftMask,             XK_r, setlayout,      { 0 } },
+	{ MODKEY|ControlMask,           XK_r, keymode,        { .i = ModeResize } },
 	{ MODKEY,                       XK_t, togglefloating, { 0 } },
 	{ MODKEY,                       XK_a, spawn,          SHCMD(TERMINAL) },
 	{ MODKEY|ShiftMask,             XK_a, spawn,          SHCMD("st") },
@@ -505,6 +860,7 @@ static const Key keys[] = {
 	{ MODKEY|ShiftMask,             XK_d, spawn,          SHCMD("evince") },
 	{ MODKEY,                       XK_f, spawn,          SHCMD("google-chrome-stable") },
 	{ MODKEY|ShiftMask,             XK_f, spawn,          SHCMD("vieb") },
+	{ MODKEY,                       XK_x, keymode,        { .i = ModeLaunch } },
 	{ MODKEY|ShiftMask|ControlMask, XK_x, togglescratch,  { .v = kimuxcmd } },
 	{ MODKEY,                       XK_b, togglebar,      { 0 } },
 	{ MODKEY|ShiftMask,             XK_b, tabmode,        { -1 } },
@@ -530,6 +886,7 @@ static const Key keys[] = {
 	{ MODKEY|ShiftMask,   XK_Tab,       cyclelayout, { .i = -1 } },
 	{ MODKEY,             XK_Delete,    spawn,       SHCMD("xmenu-shutdown") },
 	{ MODKEY|ShiftMask,   XK_Delete,    quit,        { 0 } },
+	{ MODKEY|ControlMask, XK_Delete,    restart,     { 0 } },
 	{ MODKEY|ShiftMask,   XK_BackSpace, spawn,       SHCMD("loginctl lock-session") },
 	{ MODKEY,             XK_Return,    spawn,       SHCMD(TERMINAL) },
 	{ MODKEY|ShiftMask,   XK_Return,    spawn,       SHCMD("st") },
@@ -569,6 +926,17 @@ static const Key keys[] = {
 	{ 0, XF86XK_Explorer,          spawn,  SHCMD("google-chrome-stable") },
 	{ 0, XF86XK_Calculator,        spawn,  SHCMD(TERMINAL " -e ghci") },
 	// }}}
+	// Modes {{{
+	{ 0, XK_t,      spawn,      SHCMD(TERMINAL),               ModeLaunch },
+	{ 0, XK_b,      spawn,      SHCMD("google-chrome-stable"), ModeLaunch },
+	{ 0, XK_f,      spawn,      SHCMD(TERMINAL " -e nnn"),     ModeLaunch },
+	{ 0, XK_h,      setmfact,   { .f = -0.05 },                ModeResize },
+	{ 0, XK_l,      setmfact,   { .f = +0.05 },                ModeResize },
+	{ 0, XK_j,      incnmaster, { .i = -1 },                   ModeResize },
+	{ 0, XK_k,      incnmaster, { .i = +1 },                   ModeResize },
+	{ 0, XK_Escape, keymode,    { .i = ModeRoot },             ModeResize },
+	{ 0, XK_Return, keymode,    { .i = ModeRoot },             ModeResize },
+	// }}}
 };
 // }}}
 // Mouse {{{
@@ -607,6 +975,53 @@ static const Button buttons[] = {
 	{ ClkTabBar,     0,      Button2, togglefloating, {0} },
 };
 // }}}
+// Config file names {{{
+// Names usable in the config file, see dwm(1). Keep commands sorted.
+static const Command commands[] = {
+	/* name            function        argument */
+	{ "cyclelayout",    cyclelayout,    ArgInt },
+	{ "focusmaster",    focusmaster,    ArgNone },
+	{ "focusmon",       focusmon,       ArgInt },
+	{ "focusstack",     focusstack,     ArgInt },
+	{ "focuswin",       focuswin,       ArgInt },
+	{ "incnmaster",     incnmaster,     ArgInt },
+	{ "keymode",        keymode,        ArgMode },
+	{ "killclient",     killclient,     ArgNone },
+	{ "layoutmenu",     layoutmenu,     ArgNone },
+	{ "movemouse",      movemouse,      ArgNone },
+	{ "movestack",      movestack,      ArgInt },
+	{ "quit",           quit,           ArgNone },
+	{ "resizemouse",    resizemouse,    ArgNone },
+	{ "restart",        restart,        ArgNone },
+	{ "setlayout",      setlayout,      ArgLayout },
+	{ "setmfact",       setmfact,       ArgFloat },
+	{ "spawn",          spawn,          ArgCmd },
+	{ "tabmode",        tabmode,        ArgInt },
+	{ "tag",            tag,            ArgTag },
+	{ "tagmon",         tagmon,         ArgInt },
+	{ "togglebar",      togglebar,      ArgNone },
+	{ "togglefloating", togglefloating, ArgNone },
+	{ "togglescratch",  togglescratch,  ArgScratch },
+	{ "toggletag",      toggletag,      ArgTag },
+	{ "toggleview",     toggleview,     ArgTag },
+	{ "view",           view,           ArgTag },
+	{ "zoom",           zoom,           ArgNone },
+};
+static const char* clicknames[] = {
+	[ClkTagBar]     = "tagbar",
+	[ClkTabBar]     = "tabbar",
+	[ClkLtSymbol]   = "ltsymbol",
+	[ClkStatusText] = "status",
+	[ClkButton]     = "button",
+	[ClkWinTitle]   = "wintitle",
+	[ClkClientWin]  = "clientwin",
+	[ClkRootWin]    = "rootwin",
+};
+static const char* schemenames[] = {
+	[SchemeNorm] = "norm",
+	[SchemeSel]  = "sel",
+};
+// }}}
 // }}}
 
 #endif /* ifndef DWM_H */
@@ -0,0 +1,132 @@
+/* dwmrules - compile a text rules file for dwm
+ *
+ * Every non-empty line that does not start with '#' is a rule; its fields
+ * are separated by one or more tabs, in the order of rules[] in dwm.h:
+ *
+ *   class  instance  title  tags  isfloating  monitor  x  y  w  h
+ *   floatborderpx  scratchkey
+ *
+ * A pattern of "-" matches anything. Trailing fields may be left out and
+ * default to 0 for tags and isfloating, -1 for monitor, the float geometry
+ * and floatborderpx, and no scratchkey. Numbers are parsed by strtol(3), so
+ * tags may be given as 0x100.
+ *
+ * The output is written next to the target and renamed over it, so a running
+ * dwm picks up the whole file at once.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rules.h"
+#include "util.h"
+
+#define NFIELDS 12
+
+static void usage(void)
+{
+	die("usage: dwmrules input output\n       dwmrules -d compiled");
+}
+
+static void dump(const char* path)
+{
+	RuleIndex*     ri;
+	const RuleRec* r;
+	const char*    p;
+	uint32_t       i;
+	int            f;
+
+	if (! (ri = ri_open(path)))
+		die("dwmrules: %s:", path);
+	for (i = 0; i < ri->nrules; i++) {
+		for (f = 0; f < RuleLast; f++)
+			printf("%s\t", (p = ri_pattern(ri, i, f)) ? p : "-");
+		r = &ri->rec[i];
+		printf(
+			"%#x\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t",
+			r->tags,
+			r->isfloating,
+			r->monitor,
+			r->floatx,
+			r->floaty,
+			r->floatw,
+			r->floath,
+			r->floatborderpx);
+		if (r->scratchkey)
+			printf("%c\n", r->scratchkey);
+		else
+			printf("-\n");
+	}
+	ri_free(ri);
+}
+
+static long number(const char* s, const char* path, int line)
+{
+	char* end;
+	long  n;
+
+	errno = 0;
+	n     = strtol(s, &end, 0);
+	if (errno || *end)
+		die("dwmrules: %s:%d: invalid number '%s'", path, line, s);
+	return n;
+}
+
+int main(int argc, char* argv[])
+{
+	const char** pats = NULL;
+	RuleRec*     recs = NULL, *r;
+	FILE*        fp;
+	RuleIndex*   ri;
+	char         buf[BUFSIZ], *field[NFIELDS], *p;
+	size_t       n = 0, cap = 0;
+	int          line = 0, nf, f;
+
+	if (argc == 3 && ! strcmp(argv[1], "-d")) {
+		dump(argv[2]);
+		return EXIT_SUCCESS;
+	}
+	if (argc != 3 || argv[1][0] == '-')
+		usage();
+
+	if (! (fp = fopen(argv[1], "r")))
+		die("dwmrules: %s:", argv[1]);
+	while (fgets(buf, sizeof buf, fp)) {
+		line++;
+		buf[strcspn(buf, "\n")] = '\0';
+		if (! buf[0] || buf[0] == '#')
+			continue;
+		for (nf = 0, p = strtok(buf, "\t"); p && nf < NFIELDS; p = strtok(NULL, "\t"))
+			field[nf++] = p;
+		if (p || nf < RuleLast)
+			die("dwmrules: %s:%d: expected %d to %d fields", argv[1], line, RuleLast, NFIELDS);
+
+		if (n == cap) {
+			cap  = cap ? cap * 2 : 64;
+			pats = erealloc(pats, cap * RuleLast * sizeof(char*));
+			recs = erealloc(recs, cap * sizeof(RuleRec));
+		}
+		for (f = 0; f < RuleLast; f++)
+			pats[n * RuleLast + f] = strcmp(field[f], "-") ? strdup(field[f]) : NULL;
+		r                = &recs[n++];
+		r->tags          = nf > 3 ? number(field[3], argv[1], line) : 0;
+		r->isfloating    = nf > 4 ? number(field[4], argv[1], line) : 0;
+		r->monitor       = nf > 5 ? number(field[5], argv[1], line) : -1;
+		r->floatx        = nf > 6 ? number(field[6], argv[1], line) : -1;
+		r->floaty        = nf > 7 ? number(field[7], argv[1], line) : -1;
+		r->floatw        = nf > 8 ? number(field[8], argv[1], line) : -1;
+		r->floath        = nf > 9 ? number(field[9], argv[1], line) : -1;
+		r->floatborderpx = nf > 10 ? number(field[10], argv[1], line) : -1;
+		r->scratchkey    = nf > 11 && strcmp(field[11], "-") ? field[11][0] : 0;
+	}
+	if (ferror(fp))
+		die("dwmrules: %s:", argv[1]);
+	fclose(fp);
+
+	ri = ri_create(pats, recs, n);
+	if (ri_write(ri, argv[2]) < 0)
+		die("dwmrules: %s:", argv[2]);
+	ri_free(ri);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ipc.h"
+#include "util.h"
+
+IpcConn* ipcconns;
+
+int ipc_listen(const char* path)
+{
+	struct sockaddr_un sa = {.sun_family = AF_UNIX};
+	mode_t             mask;
+	int                fd, bound;
+
+	if (strlen(path) >= sizeof sa.sun_path) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(sa.sun_path, path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+	/* only one dwm runs per display, whatever is left there is stale */
+	unlink(path);
+	/* the socket is created 0600, it is never reachable with wider modes */
+	mask  = umask(077);
+	bound = bind(fd, (struct sockaddr*) &sa, sizeof sa) == 0;
+	umask(mask);
+	if (! bound || listen(fd, 8) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+IpcConn* ipc_accept(int fd)
+{
+	IpcConn* c;
+	int      cfd;
+
+	if ((cfd = accept(fd, NULL, NULL)) < 0)
+		return NULL;
+	fcntl(cfd, F_SETFL, O_NONBLOCK);
+	fcntl(cfd, F_SETFD, FD_CLOEXEC);
+	c        = ecalloc(1, sizeof(IpcConn));
+	c->fd    = cfd;
+	c->next  = ipcconns;
+	ipcconns = c;
+	return c;
+}
+
+IpcConn* ipc_find(int fd)
+{
+	IpcConn* c;
+
+	for (c = ipcconns; c && c->fd != fd; c = c->next)
+		;
+	return c;
+}
+
+void ipc_close(IpcConn* c)
+{
+	IpcConn** p;
+
+	for (p = &ipcconns; *p && *p != c; p = &(*p)->next)
+		;
+	if (*p)
+		*p = c->next;
+	close(c->fd);
+	free(c->out);
+	free(c);
+}
+
+int ipc_read(IpcConn* c, void (*func)(IpcConn* c, char* line))
+{
+	ssize_t n;
+	char *  p, *nl;
+
+	for (;;) {
+		n = read(c->fd, c->in + c->inlen, sizeof c->in - c->inlen);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return 1;
+		if (n <= 0)
+			return 0;
+		c->inlen += n;
+		for (p = c->in; (nl = memchr(p, '\n', c->in + c->inlen - p)); p = nl + 1) {
+			*nl = '\0';
+			func(c, p);
+		}
+		c->inlen -= p - c->in;
+		memmove(c->in, p, c->inlen);
+		if (c->inlen == sizeof c->in) /* line too long */
+			return 0;
+	}
+}
+
+static void reserve(IpcConn* c, size_t n)
+{
+	if (c->outlen + n <= c->outcap)
+		return;
+	c->outcap = MAX(c->outcap * 2, c->outlen + n);
+	c->out    = erealloc(c->out, c->outcap);
+}
+
+void ipc_printf(IpcConn* c, const char* fmt, ...)
+{
+	va_list ap;
+	int     n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	reserve(c, n + 1);
+	va_start(ap, fmt);
+	vsnprintf(c->out + c->outlen, n + 1, fmt, ap);
+	va_end(ap);
+	c->outlen += n;
+}
+
+void ipc_printstr(IpcConn* c, const char* s)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char     ch;
+	size_t            len = strlen(s), n;
+
+	reserve(c, 6 * len + 2);
+	c->out[c->outlen++] = '"';
+	for (; (ch = *s); s += n, len -= n) {
+		n = 1;
+		if (ch == '"' || ch == '\\') {
+			c->out[c->outlen++] = '\\';
+			c->out[c->outlen++] = ch;
+		} else if (ch < 0x20) {
+			memcpy(c->out + c->outlen, "\\u00", 4);
+			c->out[c->outlen + 4] = hex[ch >> 4];
+			c->out[c->outlen + 5] = hex[ch & 15];
+			c->outlen += 6;
+		} else if (ch < 0x80)
+			c->out[c->outlen++] = ch;
+		else if ((n = utf8seq(s, len))) {
+			memcpy(c->out + c->outlen, s, n);
+			c->outlen += n;
+		} else {
+			/* Latin-1 and locale titles need not be UTF-8, JSON must be */
+			memcpy(c->out + c->outlen, "\xef\xbf\xbd", 3); /* U+FFFD */
+			c->outlen += 3;
+			n = 1;
+		}
+	}
+	c->out[c->outlen++] = '"';
+}
+
+int ipc_flush(IpcConn* c)
+{
+	ssize_t n;
+	size_t  off = 0;
+
+	while (off < c->outlen) {
+		if ((n = write(c->fd, c->out + off, c->outlen - off)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return 0;
+			break;
+		}
+		off += n;
+	}
+	c->outlen -= off;
+	memmove(c->out, c->out + off, c->outlen);
+	/* a consumer that stopped reading does not get to grow us without bound */
+	return c->outlen <= IPCMAXOUT;
+}
@@ -0,0 +1,40 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stddef.h>
+
+#define IPCMAXLINE 4096      /* longest request */
+#define IPCMAXOUT  (1 << 20) /* unsent output before a client is dropped */
+
+/* events a connection can subscribe to */
+enum { IpcTag = 1 << 0, IpcFocus = 1 << 1, IpcLayout = 1 << 2, IpcTitle = 1 << 3 };
+
+/* A connection to the IPC socket. Requests are lines, replies and events are
+ * JSON objects one per line, buffered until ipc_flush(). */
+typedef struct IpcConn IpcConn;
+struct IpcConn {
+	int          fd;
+	unsigned int subs;
+	char         in[IPCMAXLINE];
+	size_t       inlen;
+	char*        out;
+	size_t       outlen, outcap;
+	IpcConn*     next;
+};
+
+extern IpcConn* ipcconns;
+
+int      ipc_listen(const char* path); /* -1 with errno set */
+IpcConn* ipc_accept(int fd);
+IpcConn* ipc_find(int fd);
+void     ipc_close(IpcConn* c);
+
+/* Calls func for every complete line read, returns 0 once the peer is gone
+ * or misbehaved and the connection has to be closed. */
+int ipc_read(IpcConn* c, void (*func)(IpcConn* c, char* line));
+
+void ipc_printf(IpcConn* c, const char* fmt, ...);
+void ipc_printstr(IpcConn* c, const char* s); /* as a JSON string */
+int  ipc_flush(IpcConn* c);                   /* 0 if c has to be closed */
+
+#endif /* ifndef IPC_H */
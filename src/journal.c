@@ -0,0 +1,196 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "util.h"
+
+#define JNMagic   0x4a4d5744 /* "DWMJ" in native byte order */
+#define JNVersion 2
+#define JNMinLog  (64 * 1024) /* bytes of records between compactions */
+#define JNRecLen  (1 + (sizeof(ClientState) > sizeof(MonState) ? sizeof(ClientState) : sizeof(MonState)) / sizeof(uint32_t))
+
+enum {
+	HdrMagic,
+	HdrVersion,
+	HdrRecLen, /* in words, it changes with the build */
+	HdrSession,
+	HdrSnapLen, /* in bytes, state blobs are whole words */
+	HdrRecs,    /* records committed */
+	HdrMaxRecs,
+	HdrLen
+};
+
+Journal* jn_create(const char* path, uint32_t session, const SavedState* s)
+{
+	Journal* j;
+	char     tmp[PATH_MAX];
+	void*    snap, *map;
+	size_t   snaplen, size, maxrecs;
+	int      fd;
+
+	if (snprintf(tmp, sizeof tmp, "%s.tmp", path) >= sizeof tmp) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	snap    = st_encode(s, &snaplen);
+	maxrecs = MAX(JNMinLog, 2 * snaplen) / (JNRecLen * sizeof(uint32_t));
+	size    = HdrLen * sizeof(uint32_t) + snaplen + maxrecs * JNRecLen * sizeof(uint32_t);
+
+	/* whatever is left at tmp is stale, and never followed if it is a link */
+	if (unlink(tmp) < 0 && errno != ENOENT) {
+		free(snap);
+		return NULL;
+	}
+	if ((fd = open(tmp, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0) {
+		free(snap);
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0 ||
+			(map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		unlink(tmp);
+		free(snap);
+		return NULL;
+	}
+	close(fd);
+
+	j       = ecalloc(1, sizeof(Journal));
+	j->map  = map;
+	j->size = size;
+	j->path = ecalloc(strlen(path) + 1, 1);
+	strcpy(j->path, path);
+	j->map[HdrMagic]   = JNMagic;
+	j->map[HdrVersion] = JNVersion;
+	j->map[HdrRecLen]  = JNRecLen;
+	j->map[HdrSession] = session;
+	j->map[HdrSnapLen] = snaplen;
+	j->map[HdrRecs]    = 0;
+	j->map[HdrMaxRecs] = maxrecs;
+	memcpy(j->map + HdrLen, snap, snaplen);
+	free(snap);
+	if (rename(tmp, path) < 0) {
+		unlink(tmp);
+		jn_free(j, 0);
+		return NULL;
+	}
+	return j;
+}
+
+void jn_free(Journal* j, int remove)
+{
+	if (! j)
+		return;
+	if (remove)
+		unlink(j->path);
+	munmap(j->map, j->size);
+	free(j->path);
+	free(j);
+}
+
+int jn_append(Journal* j, int type, const void* rec)
+{
+	uint32_t* r;
+
+	if (j->map[HdrRecs] == j->map[HdrMaxRecs])
+		return 0;
+	r = j->map + HdrLen + j->map[HdrSnapLen] / sizeof(uint32_t) + j->map[HdrRecs] * JNRecLen;
+	memset(r, 0, JNRecLen * sizeof(uint32_t));
+	r[0] = type;
+	switch (type) {
+	case JnClient: memcpy(r + 1, rec, sizeof(ClientState)); break;
+	case JnMon: memcpy(r + 1, rec, sizeof(MonState)); break;
+	default: memcpy(r + 1, rec, sizeof(uint32_t)); break;
+	}
+	/* the record is complete before it is counted */
+	j->map[HdrRecs]++;
+	return 1;
+}
+
+static void replayclient(SavedState* s, const ClientState* c)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->nclients && s->clients[i].win != c->win; i++)
+		;
+	if (i == s->nclients)
+		s->clients = erealloc(s->clients, ++s->nclients * sizeof(ClientState));
+	s->clients[i] = *c;
+}
+
+static void replaymon(SavedState* s, const MonState* m)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->nmons && s->mons[i].num != m->num; i++)
+		;
+	if (i == s->nmons)
+		s->mons = erealloc(s->mons, ++s->nmons * sizeof(MonState));
+	s->mons[i] = *m;
+}
+
+static void replaygone(SavedState* s, uint32_t win)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->nclients && s->clients[i].win != win; i++)
+		;
+	if (i < s->nclients)
+		memmove(&s->clients[i], &s->clients[i + 1], (--s->nclients - i) * sizeof(ClientState));
+}
+
+int jn_replay(const char* path, uint32_t session, SavedState* s)
+{
+	const uint32_t* map, *r;
+	struct stat     st;
+	ClientState     c;
+	MonState        m;
+	uint32_t        i;
+	int             fd, ok = 0;
+
+	memset(s, 0, sizeof *s);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	if (fstat(fd, &st) < 0 || st.st_size < HdrLen * sizeof(uint32_t) ||
+			(map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	if (
+		map[HdrMagic] != JNMagic || map[HdrVersion] != JNVersion ||
+		map[HdrRecLen] != JNRecLen || map[HdrSession] != session ||
+		map[HdrSnapLen] % sizeof(uint32_t) ||
+		map[HdrSnapLen] > st.st_size - HdrLen * sizeof(uint32_t) ||
+		map[HdrRecs] > map[HdrMaxRecs] ||
+		(uint64_t) map[HdrMaxRecs] * JNRecLen * sizeof(uint32_t) >
+			st.st_size - HdrLen * sizeof(uint32_t) - map[HdrSnapLen])
+		goto out;
+	if (! st_decode(s, map + HdrLen, map[HdrSnapLen]))
+		goto out;
+
+	r = map + HdrLen + map[HdrSnapLen] / sizeof(uint32_t);
+	for (i = 0; i < map[HdrRecs]; i++, r += JNRecLen) {
+		switch (r[0]) {
+		case JnClient:
+			memcpy(&c, r + 1, sizeof c);
+			replayclient(s, &c);
+			break;
+		case JnMon:
+			memcpy(&m, r + 1, sizeof m);
+			replaymon(s, &m);
+			break;
+		case JnGone: replaygone(s, r[1]); break;
+		case JnSelMon: s->selmon = r[1]; break;
+		}
+	}
+	ok = 1;
+out:
+	munmap((void*) map, st.st_size);
+	return ok;
+}
@@ -0,0 +1,36 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "state.h"
+
+enum { JnClient, JnMon, JnGone, JnSelMon }; /* record types */
+
+/* A state snapshot followed by fixed size records of what changed since,
+ * in a shared mapping of the file. Appends are plain stores into the
+ * mapping, they reach the file whenever the kernel writes the pages back,
+ * which is enough to outlive a crash of dwm itself. */
+typedef struct {
+	char*     path;
+	uint32_t* map;
+	size_t    size; /* in bytes */
+} Journal;
+
+/* jn_create() writes s as the snapshot of a fresh journal next to path and
+ * renames it over path, so it also compacts a full one. It returns NULL with
+ * errno set on failure. session names the X server the windows are on. */
+Journal* jn_create(const char* path, uint32_t session, const SavedState* s);
+void     jn_free(Journal* j, int remove);
+
+/* rec is a ClientState or MonState for JnClient and JnMon, the window or
+ * monitor number for JnGone and JnSelMon. Returns 0 when the journal is full
+ * and has to be compacted. */
+int jn_append(Journal* j, int type, const void* rec);
+
+/* Replays the journal at path into s, returns 0 if there is none, it is not
+ * one of this build or it was written for another session. */
+int jn_replay(const char* path, uint32_t session, SavedState* s);
+
+#endif /* ifndef JOURNAL_H */
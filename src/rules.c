@@ -0,0 +1,560 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rules.h"
+#include "util.h"
+
+#define RINone     UINT32_MAX
+#define RIMaxState (1u << 24) /* targets share an edge word with the label */
+#define RIMagic    0x524d5744 /* "DWMR" in native byte order */
+#define RIVersion  1
+#define RIRecLen   (sizeof(RuleRec) / sizeof(uint32_t))
+
+/* layout of a state in RuleField.node */
+enum { NodeEdge, NodeNEdge, NodeFail, NodeDict, NodePat, RINodeLen };
+/* Per field header words. Tables are addressed in words from the start of the
+ * blob, the header itself is followed by the rule records, the pattern
+ * offsets, the string table and then the tables of every field. */
+enum {
+	FldNode,
+	FldNNodes,
+	FldEdge,
+	FldRoot,
+	FldPat,
+	FldNPats,
+	FldPRule,
+	FldNPRule,
+	FldAny,
+	FldLen
+};
+enum {
+	HdrMagic,
+	HdrVersion,
+	HdrSize,
+	HdrRules,
+	HdrWords,
+	HdrRec,
+	HdrPatOff,
+	HdrStr,
+	HdrStrLen, /* in bytes */
+	HdrField,
+	HdrLen = HdrField + RuleLast * FldLen
+};
+static const int fldoffsets[] = {FldNode, FldEdge, FldRoot, FldPat, FldPRule, FldAny};
+
+typedef struct {
+	uint32_t      child, sibling, fail, dict, pat;
+	unsigned char label;
+} BNode;
+
+typedef struct {
+	BNode*   n;
+	uint32_t len, cap;
+} Trie;
+
+static uint32_t hashstr(const char* s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return h;
+}
+
+static uint32_t trie_child(const Trie* t, uint32_t v, unsigned char label)
+{
+	uint32_t c;
+
+	for (c = t->n[v].child; c && t->n[c].label != label; c = t->n[c].sibling)
+		;
+	return c;
+}
+
+static void trie_insert(Trie* t, const char* s, uint32_t pat)
+{
+	uint32_t v = 0, c;
+
+	for (; *s; s++, v = c) {
+		if ((c = trie_child(t, v, *s)))
+			continue;
+		if (t->len == RIMaxState)
+			die("rules: too many pattern states");
+		if (t->len == t->cap)
+			t->n = erealloc(t->n, (t->cap *= 2) * sizeof(BNode));
+		c = t->len++;
+		memset(&t->n[c], 0, sizeof(BNode));
+		t->n[c].pat     = RINone;
+		t->n[c].label   = *s;
+		t->n[c].sibling = t->n[v].child;
+		t->n[v].child   = c;
+	}
+	t->n[v].pat = pat;
+}
+
+/* breadth first, so the failure state of a parent is always final */
+static void trie_link(Trie* t)
+{
+	uint32_t *queue, head = 0, tail = 0, u, c, f, g;
+
+	queue = ecalloc(t->len, sizeof(uint32_t));
+	for (c = t->n[0].child; c; c = t->n[c].sibling)
+		queue[tail++] = c;
+	while (head < tail) {
+		u = queue[head++];
+		for (c = t->n[u].child; c; c = t->n[c].sibling) {
+			for (f = t->n[u].fail; f && ! trie_child(t, f, t->n[c].label);
+			     f = t->n[f].fail)
+				;
+			g            = trie_child(t, f, t->n[c].label);
+			t->n[c].fail = g;
+			t->n[c].dict = t->n[g].pat != RINone ? g : t->n[g].dict;
+			queue[tail++] = c;
+		}
+	}
+	free(queue);
+}
+
+/* Distinct patterns are interned by their exact string, so every state of the
+ * automaton reports at most one pattern and all rules sharing that pattern
+ * are resolved in a single step. */
+static uint32_t* buildfield(
+	const char* const* patterns,
+	size_t             nrules,
+	int                f,
+	uint32_t           nwords,
+	uint32_t*          hdr,
+	size_t*            len)
+{
+	Trie         t;
+	const char*  s;
+	const char** strs;
+	uint32_t *   sec, *pid, *slot, *node, *edge, *pat, *prule, *any;
+	uint32_t     nslots, npats = 0, nprule = 0, r, h, v, c, e, i, j, tmp;
+
+	t.cap = 64;
+	t.len = 1;
+	t.n   = ecalloc(t.cap, sizeof(BNode));
+	t.n[0].pat = RINone;
+
+	for (nslots = 2; nslots < 2 * nrules; nslots *= 2)
+		;
+	pid  = ecalloc(nrules + 1, sizeof(uint32_t));
+	slot = ecalloc(nslots, sizeof(uint32_t));
+	strs = ecalloc(nrules + 1, sizeof(char*));
+	for (r = 0; r < nrules; r++) {
+		s = patterns[r * RuleLast + f];
+		if (! s || ! *s) {
+			pid[r] = RINone;
+			continue;
+		}
+		for (h = hashstr(s) & (nslots - 1); slot[h] && strcmp(strs[slot[h] - 1], s);
+		     h = (h + 1) & (nslots - 1))
+			;
+		if (! slot[h]) {
+			strs[npats] = s;
+			trie_insert(&t, s, npats);
+			slot[h] = ++npats;
+		}
+		pid[r] = slot[h] - 1;
+		nprule++;
+	}
+	trie_link(&t);
+
+	hdr[FldNode]   = 0;
+	hdr[FldNNodes] = t.len;
+	hdr[FldEdge]   = hdr[FldNode] + t.len * RINodeLen;
+	hdr[FldRoot]   = hdr[FldEdge] + t.len - 1;
+	hdr[FldPat]    = hdr[FldRoot] + 256;
+	hdr[FldNPats]  = npats;
+	hdr[FldPRule]  = hdr[FldPat] + 2 * npats;
+	hdr[FldNPRule] = nprule;
+	hdr[FldAny]    = hdr[FldPRule] + nprule;
+	*len           = hdr[FldAny] + nwords;
+
+	sec   = ecalloc(*len, sizeof(uint32_t));
+	node  = sec + hdr[FldNode];
+	edge  = sec + hdr[FldEdge];
+	pat   = sec + hdr[FldPat];
+	prule = sec + hdr[FldPRule];
+	any   = sec + hdr[FldAny];
+	for (v = 0, e = 0; v < t.len; v++, node += RINodeLen) {
+		node[NodeEdge] = e;
+		for (c = t.n[v].child; c; c = t.n[c].sibling)
+			edge[e++] = (uint32_t) t.n[c].label << 24 | c;
+		node[NodeNEdge] = e - node[NodeEdge];
+		node[NodeFail]  = t.n[v].fail;
+		node[NodeDict]  = t.n[v].dict;
+		node[NodePat]   = t.n[v].pat;
+		/* labels are unique per state, sorting the words sorts the labels */
+		for (i = node[NodeEdge] + 1; i < e; i++)
+			for (j = i, tmp = edge[i]; j > node[NodeEdge] && edge[j - 1] > tmp; j--)
+				edge[j] = edge[j - 1], edge[j - 1] = tmp;
+	}
+	for (c = t.n[0].child; c; c = t.n[c].sibling)
+		sec[hdr[FldRoot] + t.n[c].label] = c;
+
+	for (r = 0; r < nrules; r++)
+		if (pid[r] != RINone)
+			pat[2 * pid[r] + 1]++;
+	for (i = 0, j = 0; i < npats; j += pat[2 * i + 1], pat[2 * i + 1] = 0, i++)
+		pat[2 * i] = j;
+	for (r = 0; r < nrules; r++) {
+		if (pid[r] == RINone)
+			any[r >> 5] |= 1u << (r & 31);
+		else
+			prule[pat[2 * pid[r]] + pat[2 * pid[r] + 1]++] = r;
+	}
+
+	free(strs);
+	free(slot);
+	free(pid);
+	free(t.n);
+	return sec;
+}
+
+static void ri_attach(RuleIndex* ri, const uint32_t* blob)
+{
+	const uint32_t* h;
+	int             f;
+
+	ri->nrules = blob[HdrRules];
+	ri->nwords = blob[HdrWords];
+	ri->rec    = (const RuleRec*) (blob + blob[HdrRec]);
+	ri->patoff = blob + blob[HdrPatOff];
+	ri->str    = (const char*) (blob + blob[HdrStr]);
+	for (f = 0; f < RuleLast; f++) {
+		h                  = blob + HdrField + f * FldLen;
+		ri->field[f].node  = blob + h[FldNode];
+		ri->field[f].edge  = blob + h[FldEdge];
+		ri->field[f].root  = blob + h[FldRoot];
+		ri->field[f].pat   = blob + h[FldPat];
+		ri->field[f].prule = blob + h[FldPRule];
+		ri->field[f].any   = blob + h[FldAny];
+		ri->field[f].npats = h[FldNPats];
+	}
+	ri->acc = ecalloc(ri->nwords, sizeof(uint32_t));
+	ri->tmp = ecalloc(ri->nwords, sizeof(uint32_t));
+}
+
+static int span(uint32_t off, uint64_t len, size_t size)
+{
+	return off <= size && len <= size - off;
+}
+
+/* Checks every table of a field, so that matching against it can neither
+ * leave the blob nor loop: failure and dictionary links have to point to
+ * strictly shallower states. */
+static int validfield(const uint32_t* b, size_t size, const uint32_t* h)
+{
+	const uint32_t *node, *edge, *pat, *prule;
+	uint32_t *      depth, nn, v, e, t, prev, ok = 0;
+
+	nn = h[FldNNodes];
+	if (! nn || nn > RIMaxState || ! span(h[FldNode], (uint64_t) nn * RINodeLen, size) ||
+	    ! span(h[FldEdge], nn - 1, size) || ! span(h[FldRoot], 256, size) ||
+	    ! span(h[FldPat], 2 * (uint64_t) h[FldNPats], size) ||
+	    ! span(h[FldPRule], h[FldNPRule], size) ||
+	    ! span(h[FldAny], b[HdrWords], size))
+		return 0;
+	node  = b + h[FldNode];
+	edge  = b + h[FldEdge];
+	pat   = b + h[FldPat];
+	prule = b + h[FldPRule];
+
+	/* states are numbered in creation order, parents before children */
+	depth = ecalloc(nn, sizeof(uint32_t));
+	for (v = 0; v < nn; v++, node += RINodeLen) {
+		if (! span(node[NodeEdge], node[NodeNEdge], nn - 1))
+			goto out;
+		for (e = 0, prev = 0; e < node[NodeNEdge]; e++, prev = t) {
+			t = edge[node[NodeEdge] + e];
+			if ((e && t >> 24 <= prev >> 24) || (t & (RIMaxState - 1)) <= v ||
+			    (t & (RIMaxState - 1)) >= nn || depth[t & (RIMaxState - 1)])
+				goto out;
+			depth[t & (RIMaxState - 1)] = depth[v] + 1;
+		}
+	}
+	for (v = 0, node = b + h[FldNode]; v < nn; v++, node += RINodeLen) {
+		if ((v && ! depth[v]) || node[NodeFail] >= nn || node[NodeDict] >= nn ||
+		    (node[NodePat] != RINone && node[NodePat] >= h[FldNPats]))
+			goto out;
+		if (v && (depth[node[NodeFail]] >= depth[v] || depth[node[NodeDict]] >= depth[v]))
+			goto out;
+		if (node[NodeDict] &&
+		    b[h[FldNode] + node[NodeDict] * RINodeLen + NodePat] == RINone)
+			goto out;
+	}
+	for (v = 0; v < 256; v++)
+		if (b[h[FldRoot] + v] >= nn)
+			goto out;
+	for (v = 0; v < h[FldNPats]; v++)
+		if (! span(pat[2 * v], pat[2 * v + 1], h[FldNPRule]))
+			goto out;
+	for (v = 0; v < h[FldNPRule]; v++)
+		if (prule[v] >= b[HdrRules])
+			goto out;
+	ok = 1;
+out:
+	free(depth);
+	return ok;
+}
+
+static int validblob(const uint32_t* b, size_t size)
+{
+	const char* str;
+	uint64_t    nrules;
+	uint32_t    i;
+	int         f;
+
+	if (size < HdrLen || b[HdrMagic] != RIMagic || b[HdrVersion] != RIVersion ||
+	    b[HdrSize] != size)
+		return 0;
+	nrules = b[HdrRules];
+	if (b[HdrWords] != nrules / 32 + 1 || ! span(b[HdrRec], nrules * RIRecLen, size) ||
+	    ! span(b[HdrPatOff], nrules * RuleLast, size) ||
+	    ! span(b[HdrStr], ((uint64_t) b[HdrStrLen] + 3) / 4, size))
+		return 0;
+	str = (const char*) (b + b[HdrStr]);
+	if (b[HdrStrLen] && str[b[HdrStrLen] - 1])
+		return 0;
+	for (i = 0; i < nrules * RuleLast; i++)
+		if (b[b[HdrPatOff] + i] > b[HdrStrLen])
+			return 0;
+	for (f = 0; f < RuleLast; f++)
+		if (! validfield(b, size, b + HdrField + f * FldLen))
+			return 0;
+	return 1;
+}
+
+RuleIndex* ri_create(
+	const char* const* patterns,
+	const RuleRec*     recs,
+	size_t             nrules)
+{
+	RuleIndex*  ri;
+	uint32_t    hdr[HdrLen], *sec[RuleLast], *h, *patoff, nwords;
+	size_t      len[RuleLast], nstr = 0, off, i;
+	const char* s;
+	int         f;
+
+	nwords          = nrules / 32 + 1;
+	hdr[HdrMagic]   = RIMagic;
+	hdr[HdrVersion] = RIVersion;
+	hdr[HdrRules]   = nrules;
+	hdr[HdrWords]   = nwords;
+	hdr[HdrRec]     = HdrLen;
+	hdr[HdrPatOff]  = hdr[HdrRec] + nrules * RIRecLen;
+	hdr[HdrStr]     = hdr[HdrPatOff] + nrules * RuleLast;
+	for (i = 0; i < nrules * RuleLast; i++)
+		if ((s = patterns[i]) && *s)
+			nstr += strlen(s) + 1;
+	hdr[HdrStrLen] = nstr;
+	off            = hdr[HdrStr] + (nstr + 3) / 4;
+	for (f = 0; f < RuleLast; f++) {
+		h      = hdr + HdrField + f * FldLen;
+		sec[f] = buildfield(patterns, nrules, f, nwords, h, &len[f]);
+		for (i = 0; i < sizeof fldoffsets / sizeof fldoffsets[0]; i++)
+			h[fldoffsets[i]] += off;
+		off += len[f];
+	}
+	hdr[HdrSize] = off;
+
+	ri       = ecalloc(1, sizeof(RuleIndex));
+	ri->blob = ecalloc(off, sizeof(uint32_t));
+	memcpy(ri->blob, hdr, sizeof hdr);
+	if (nrules)
+		memcpy(ri->blob + hdr[HdrRec], recs, nrules * sizeof(RuleRec));
+	patoff = ri->blob + hdr[HdrPatOff];
+	for (i = 0, off = 0; i < nrules * RuleLast; i++) {
+		if (! (s = patterns[i]) || ! *s)
+			continue;
+		patoff[i] = off + 1;
+		memcpy((char*) (ri->blob + hdr[HdrStr]) + off, s, strlen(s) + 1);
+		off += strlen(s) + 1;
+	}
+	for (f = 0; f < RuleLast; f++) {
+		off = hdr[HdrField + f * FldLen + FldNode];
+		memcpy(ri->blob + off, sec[f], len[f] * sizeof(uint32_t));
+		free(sec[f]);
+	}
+	ri_attach(ri, ri->blob);
+	return ri;
+}
+
+void ri_free(RuleIndex* ri)
+{
+	if (! ri)
+		return;
+	free(ri->acc);
+	free(ri->tmp);
+	free(ri->blob);
+	free(ri);
+}
+
+RuleIndex* ri_open(const char* path)
+{
+	RuleIndex*  ri;
+	struct stat st;
+	uint32_t*   blob;
+	ssize_t     n;
+	size_t      off;
+	int         fd, err;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size < HdrLen * sizeof(uint32_t) || st.st_size % sizeof(uint32_t)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	/* read rather than mapped, a file rewritten in place would otherwise
+	 * change or vanish under lookups */
+	blob = ecalloc(1, st.st_size);
+	for (off = 0; off < st.st_size; off += n)
+		if ((n = read(fd, (char*) blob + off, st.st_size - off)) <= 0) {
+			if (n < 0 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			err = n < 0 ? errno : EINVAL; /* shrunk while read */
+			close(fd);
+			free(blob);
+			errno = err;
+			return NULL;
+		}
+	close(fd);
+	if (! validblob(blob, st.st_size / sizeof(uint32_t))) {
+		free(blob);
+		errno = EINVAL;
+		return NULL;
+	}
+	ri       = ecalloc(1, sizeof(RuleIndex));
+	ri->blob = blob;
+	ri_attach(ri, blob);
+	return ri;
+}
+
+/* written next to path and renamed over it, so a running dwm never reads a
+ * partially written file */
+int ri_write(const RuleIndex* ri, const char* path)
+{
+	const uint32_t* b = ri->blob;
+	char            tmp[PATH_MAX];
+	FILE*           fp;
+	int             err;
+
+	if (snprintf(tmp, sizeof tmp, "%s.tmp", path) >= sizeof tmp) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (! (fp = fopen(tmp, "wb")))
+		return -1;
+	err = fwrite(b, sizeof(uint32_t), b[HdrSize], fp) != b[HdrSize];
+	if (fclose(fp) || err || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static uint32_t ri_goto(const RuleField* f, uint32_t v, unsigned char b)
+{
+	const uint32_t* e  = f->edge + f->node[v * RINodeLen + NodeEdge];
+	uint32_t        lo = 0, hi = f->node[v * RINodeLen + NodeNEdge], mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (e[mid] >> 24 == b)
+			return e[mid] & (RIMaxState - 1);
+		if (e[mid] >> 24 < b)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return 0;
+}
+
+/* marks every rule whose pattern occurs in s */
+static void ri_scan(const RuleField* f, const char* s, uint32_t* bits)
+{
+	const uint32_t* p;
+	uint32_t        v = 0, t, u, i, r;
+	unsigned char   b;
+
+	for (; *s; s++) {
+		b = *s;
+		for (;;) {
+			if (! v) {
+				v = f->root[b];
+				break;
+			}
+			if ((t = ri_goto(f, v, b))) {
+				v = t;
+				break;
+			}
+			v = f->node[v * RINodeLen + NodeFail];
+		}
+		u = f->node[v * RINodeLen + NodePat] != RINone
+			? v
+			: f->node[v * RINodeLen + NodeDict];
+		for (; u; u = f->node[u * RINodeLen + NodeDict]) {
+			p = f->pat + 2 * f->node[u * RINodeLen + NodePat];
+			for (i = 0; i < p[1]; i++) {
+				r = f->prule[p[0] + i];
+				bits[r >> 5] |= 1u << (r & 31);
+			}
+		}
+	}
+}
+
+unsigned int ri_match(RuleIndex* ri, const char* const fields[RuleLast])
+{
+	uint32_t *dst, i, w, hit;
+	unsigned int n = 0;
+	int          f;
+
+	for (f = 0; f < RuleLast; f++) {
+		dst = f ? ri->tmp : ri->acc;
+		memcpy(dst, ri->field[f].any, ri->nwords * sizeof(uint32_t));
+		if (ri->field[f].npats && fields[f])
+			ri_scan(&ri->field[f], fields[f], dst);
+		for (i = 0, hit = 0; i < ri->nwords; i++)
+			hit |= f ? (ri->acc[i] &= dst[i]) : dst[i];
+		if (! hit)
+			return 0;
+	}
+	for (i = 0; i < ri->nwords; i++)
+		for (w = ri->acc[i]; w; w &= w - 1)
+			n++;
+	return n;
+}
+
+int ri_next(const RuleIndex* ri, int i)
+{
+	uint32_t r, w;
+
+	for (r = i + 1; r < ri->nrules; r = (r | 31) + 1)
+		if ((w = ri->acc[r >> 5] >> (r & 31))) {
+			for (; ! (w & 1); w >>= 1)
+				r++;
+			return r;
+		}
+	return -1;
+}
+
+const char* ri_pattern(const RuleIndex* ri, int i, int field)
+{
+	uint32_t off = ri->patoff[i * RuleLast + field];
+
+	return off ? ri->str + off - 1 : NULL;
+}
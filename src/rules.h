@@ -0,0 +1,65 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum { RuleClass, RuleInstance, RuleTitle, RuleLast }; /* matched fields */
+
+/* what a matching rule applies to a client */
+typedef struct {
+	uint32_t tags;
+	int32_t  isfloating;
+	int32_t  monitor;
+	int32_t  floatx, floaty, floatw, floath;
+	int32_t  floatborderpx;
+	int32_t  scratchkey;
+} RuleRec;
+
+/* One Aho-Corasick automaton per matched field. All tables are flat uint32_t
+ * arrays addressed by index, so an index can live in any contiguous block,
+ * including a read-only mapping of a compiled rules file. */
+typedef struct {
+	const uint32_t* node;  /* RINodeLen words per state, state 0 is the root */
+	const uint32_t* edge;  /* label << 24 | target, sorted per state */
+	const uint32_t* root;  /* 256 entry goto table of the root state */
+	const uint32_t* pat;   /* first, count into prule per distinct pattern */
+	const uint32_t* prule; /* rule numbers, ascending per pattern */
+	const uint32_t* any;   /* bitset of rules without a pattern in this field */
+	uint32_t        npats;
+} RuleField;
+
+typedef struct {
+	uint32_t        nrules;
+	uint32_t        nwords; /* 32 bit words per rule bitset */
+	const RuleRec*  rec;
+	const uint32_t* patoff; /* RuleLast string offsets + 1 per rule, 0 if none */
+	const char*     str;
+	RuleField       field[RuleLast];
+	uint32_t*       acc;    /* rules matched by the last ri_match() */
+	uint32_t*       tmp;
+	uint32_t*       blob;   /* owned storage of the tables */
+} RuleIndex;
+
+/* patterns holds RuleLast entries per rule, in rule order; NULL or "" matches
+ * anything, any other pattern has to occur as a substring (see strstr(3)). */
+RuleIndex* ri_create(
+	const char* const* patterns,
+	const RuleRec*     recs,
+	size_t             nrules);
+void ri_free(RuleIndex* ri);
+
+/* Compiled rules files are the blob of an index, written by ri_write() and
+ * read by ri_open(), which validates every table once so lookups never need
+ * to. ri_open() returns NULL with errno set on failure, EINVAL if the file is
+ * not a blob of this build. */
+RuleIndex* ri_open(const char* path);
+int        ri_write(const RuleIndex* ri, const char* path);
+
+/* Returns the number of rules matching all fields, iterate them in rule order
+ * with ri_next() starting from -1. */
+unsigned int ri_match(RuleIndex* ri, const char* const fields[RuleLast]);
+int          ri_next(const RuleIndex* ri, int i);
+const char*  ri_pattern(const RuleIndex* ri, int i, int field);
+
+#endif /* ifndef RULES_H */
@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "state.h"
+#include "util.h"
+
+#define STMagic   0x534d5744 /* "DWMS" in native byte order */
+#define STVersion 1
+
+enum {
+	HdrMagic,
+	HdrVersion,
+	HdrMonLen, /* record sizes, they change with the build */
+	HdrClientLen,
+	HdrSelMon,
+	HdrMons,
+	HdrClients,
+	HdrLen
+};
+
+void* st_encode(const SavedState* s, size_t* len)
+{
+	size_t    mlen = s->nmons * sizeof(MonState);
+	size_t    clen = s->nclients * sizeof(ClientState);
+	uint32_t* b;
+
+	*len            = HdrLen * sizeof(uint32_t) + mlen + clen;
+	b               = ecalloc(1, *len);
+	b[HdrMagic]     = STMagic;
+	b[HdrVersion]   = STVersion;
+	b[HdrMonLen]    = sizeof(MonState);
+	b[HdrClientLen] = sizeof(ClientState);
+	b[HdrSelMon]    = s->selmon;
+	b[HdrMons]      = s->nmons;
+	b[HdrClients]   = s->nclients;
+	if (mlen)
+		memcpy(b + HdrLen, s->mons, mlen);
+	if (clen)
+		memcpy((char*) (b + HdrLen) + mlen, s->clients, clen);
+	return b;
+}
+
+int st_decode(SavedState* s, const void* buf, size_t len)
+{
+	uint32_t    h[HdrLen];
+	const char* p = (const char*) buf + sizeof h;
+	size_t      mlen, clen;
+
+	memset(s, 0, sizeof *s);
+	if (len < sizeof h)
+		return 0;
+	memcpy(h, buf, sizeof h);
+	if (
+		h[HdrMagic] != STMagic || h[HdrVersion] != STVersion ||
+		h[HdrMonLen] != sizeof(MonState) || h[HdrClientLen] != sizeof(ClientState))
+		return 0;
+	mlen = (size_t) h[HdrMons] * sizeof(MonState);
+	clen = (size_t) h[HdrClients] * sizeof(ClientState);
+	if (len - sizeof h != mlen + clen)
+		return 0;
+
+	s->selmon   = h[HdrSelMon];
+	s->nmons    = h[HdrMons];
+	s->nclients = h[HdrClients];
+	s->mons     = ecalloc(s->nmons + 1, sizeof(MonState));
+	s->clients  = ecalloc(s->nclients + 1, sizeof(ClientState));
+	memcpy(s->mons, p, mlen);
+	memcpy(s->clients, p + mlen, clen);
+	return 1;
+}
+
+void st_free(SavedState* s)
+{
+	free(s->mons);
+	free(s->clients);
+	memset(s, 0, sizeof *s);
+}
+
+const ClientState* st_client(const SavedState* s, uint32_t win)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->nclients; i++)
+		if (s->clients[i].win == win)
+			return &s->clients[i];
+	return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Window manager state carried across a restart. Records only hold 32 bit
+ * fields, so a blob is a header and two arrays of records. */
+typedef struct {
+	int32_t  num;
+	uint32_t tagset[2];
+	uint32_t seltags;
+	uint32_t sellt;
+	uint32_t lt[2]; /* indices into layouts[] */
+	float    mfact;
+	int32_t  nmaster;
+	int32_t  showbar;
+	int32_t  showtab;
+} MonState;
+
+typedef struct {
+	uint32_t win;
+	int32_t  mon;   /* MonState.num */
+	uint32_t stack; /* position in the focus stack of its monitor */
+	uint32_t pos;   /* and in its client list */
+	uint32_t tags;
+	int32_t  isfloating;
+	int32_t  x, y, w, h;
+	int32_t  sfx, sfy, sfw, sfh;
+	int32_t  floatborderpx;
+	int32_t  hasfloatbw;
+	int32_t  scratchkey;
+} ClientState;
+
+typedef struct {
+	int32_t      selmon; /* MonState.num */
+	uint32_t     nmons;
+	uint32_t     nclients;
+	MonState*    mons;
+	ClientState* clients; /* per monitor in client list order */
+} SavedState;
+
+/* st_encode() returns a malloc'ed blob of *len bytes. st_decode() fills s with
+ * arrays owned by it and returns 0 if buf is not a blob of this build. */
+void*              st_encode(const SavedState* s, size_t* len);
+int                st_decode(SavedState* s, const void* buf, size_t len);
+void               st_free(SavedState* s);
+const ClientState* st_client(const SavedState* s, uint32_t win);
+
+#endif /* ifndef STATE_H */
@@ -0,0 +1,173 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "status.h"
+
+#define SBBufLen 256 /* covers the lines read from any source */
+
+static int sysopen(const char* fmt, const char* arg)
+{
+	char path[128];
+
+	if (! arg || snprintf(path, sizeof path, fmt, arg) >= sizeof path)
+		return -1;
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/* reads fd from its start again, which makes proc and sysfs files regenerate */
+static int reread(int fd, char* buf, size_t size)
+{
+	ssize_t n;
+
+	if ((n = pread(fd, buf, size - 1, 0)) <= 0)
+		return 0;
+	buf[n] = '\0';
+	return 1;
+}
+
+static unsigned long long nowns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* a byte count in at most four characters */
+static void human(char* buf, size_t size, double n)
+{
+	const char* unit = "BKMGT";
+
+	while (n >= 1000 && unit[1]) {
+		n /= 1024;
+		unit++;
+	}
+	snprintf(buf, size, n < 10 && *unit != 'B' ? "%.1f%c" : "%.0f%c", n, *unit);
+}
+
+int sb_open(StatusSrc* s)
+{
+	s->fd[0] = s->fd[1] = -1;
+	s->prev[0] = s->prev[1] = s->prevns = 0;
+	switch (s->kind) {
+	case SbClock:
+		return s->arg != NULL;
+	case SbCpu:
+		s->fd[0] = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+		break;
+	case SbMemory:
+		s->fd[0] = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+		break;
+	case SbLoad:
+		s->fd[0] = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+		break;
+	case SbBattery:
+		s->fd[0] = sysopen("/sys/class/power_supply/%s/capacity", s->arg);
+		s->fd[1] = sysopen("/sys/class/power_supply/%s/status", s->arg);
+		break;
+	case SbNetwork:
+		s->fd[0] = sysopen("/sys/class/net/%s/statistics/rx_bytes", s->arg);
+		s->fd[1] = sysopen("/sys/class/net/%s/statistics/tx_bytes", s->arg);
+		break;
+	default:
+		return 0;
+	}
+	if (s->fd[0] < 0 || ((s->kind == SbBattery || s->kind == SbNetwork) && s->fd[1] < 0)) {
+		sb_close(s);
+		return 0;
+	}
+	return 1;
+}
+
+void sb_close(StatusSrc* s)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (s->fd[i] >= 0)
+			close(s->fd[i]);
+		s->fd[i] = -1;
+	}
+}
+
+int sb_read(StatusSrc* s, char* buf, size_t size)
+{
+	char               in[SBBufLen], rx[8], tx[8];
+	unsigned long long v[8], total, idle, now;
+	double             secs;
+	struct tm          tm;
+	time_t             t;
+	char*              p;
+	int                i;
+
+	switch (s->kind) {
+	case SbClock:
+		t = time(NULL);
+		return localtime_r(&t, &tm) && strftime(buf, size, s->arg, &tm) > 0;
+	case SbCpu:
+		/* user nice system idle iowait irq softirq steal, in ticks */
+		if (! reread(s->fd[0], in, sizeof in) ||
+				sscanf(in, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+					&v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8)
+			return 0;
+		for (i = 0, total = 0; i < 8; i++)
+			total += v[i];
+		idle = v[3] + v[4];
+		snprintf(buf, size, "%llu%%",
+			total > s->prev[0] && idle >= s->prev[1]
+				? 100 * (total - s->prev[0] - (idle - s->prev[1])) / (total - s->prev[0])
+				: 0);
+		s->prev[0] = total;
+		s->prev[1] = idle;
+		return 1;
+	case SbMemory:
+		if (! reread(s->fd[0], in, sizeof in) ||
+				! (p = strstr(in, "MemTotal:")) || sscanf(p, "MemTotal: %llu", &v[0]) != 1 ||
+				! (p = strstr(in, "MemAvailable:")) || sscanf(p, "MemAvailable: %llu", &v[1]) != 1 ||
+				v[1] > v[0])
+			return 0;
+		human(buf, size, (v[0] - v[1]) * 1024.0);
+		return 1;
+	case SbLoad:
+		/* the 1, 5 and 15 minute averages */
+		if (! reread(s->fd[0], in, sizeof in))
+			return 0;
+		for (p = in, i = 0; *p && *p != '\n' && ! (*p == ' ' && ++i == 3); p++)
+			;
+		*p = '\0';
+		snprintf(buf, size, "%s", in);
+		return 1;
+	case SbBattery:
+		if (! reread(s->fd[0], in, sizeof in))
+			return 0;
+		v[0] = strtoull(in, NULL, 10);
+		if (! reread(s->fd[1], in, sizeof in))
+			return 0;
+		snprintf(buf, size, "%s%llu%%",
+			! strncmp(in, "Charging", 8) ? "+" : ! strncmp(in, "Discharging", 11) ? "-" : "",
+			v[0]);
+		return 1;
+	case SbNetwork:
+		if (! reread(s->fd[0], in, sizeof in))
+			return 0;
+		v[0] = strtoull(in, NULL, 10);
+		if (! reread(s->fd[1], in, sizeof in))
+			return 0;
+		v[1] = strtoull(in, NULL, 10);
+		now  = nowns();
+		secs = s->prevns && now > s->prevns ? (now - s->prevns) / 1e9 : 0;
+		/* counters start over when the interface is brought up again */
+		human(rx, sizeof rx, secs && v[0] >= s->prev[0] ? (v[0] - s->prev[0]) / secs : 0);
+		human(tx, sizeof tx, secs && v[1] >= s->prev[1] ? (v[1] - s->prev[1]) / secs : 0);
+		s->prev[0] = v[0];
+		s->prev[1] = v[1];
+		s->prevns  = now;
+		snprintf(buf, size, "\xe2\x86\x93%s \xe2\x86\x91%s", rx, tx);
+		return 1;
+	}
+	return 0;
+}
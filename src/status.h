@@ -0,0 +1,28 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stddef.h>
+
+enum { SbClock, SbCpu, SbMemory, SbBattery, SbNetwork, SbLoad, SbExternal }; /* sources */
+
+/* A built-in status source. Its descriptors stay open between updates and are
+ * reread from the start with pread(2), so an update neither forks nor
+ * allocates. */
+typedef struct {
+	int                kind;
+	const char*        arg;     /* strftime(3) format, battery or interface */
+	int                fd[2];
+	unsigned long long prev[2]; /* counters as of the last update */
+	unsigned long long prevns;  /* and when it was, 0 before the first */
+} StatusSrc;
+
+/* sb_open() returns 0 if the source does not exist on this machine, and for
+ * SbExternal, which other programs write to dwm instead. */
+int  sb_open(StatusSrc* s);
+void sb_close(StatusSrc* s);
+
+/* Writes the current value to buf, returns 0 if it could not be read. Rates
+ * are averaged over the time since the previous call. */
+int sb_read(StatusSrc* s, char* buf, size_t size);
+
+#endif /* ifndef STATUS_H */
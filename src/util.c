@@ -1,5 +1,14 @@
 #include "util.h"
 
+/* objects and slab headers are aligned for any member they may hold */
+typedef union {
+	void*       p;
+	long        l;
+	long double d;
+} SlabAlign;
+
+#define SLABSTRIDE(s) ((MAX((s)->size, sizeof(void*)) + sizeof(SlabAlign) - 1) / sizeof(SlabAlign) * sizeof(SlabAlign))
+
 void die(const char* fmt, ...)
 {
 	va_list ap;
@@ -26,3 +35,90 @@ void* ecalloc(size_t nmemb, size_t size)
 		die("calloc:");
 	return p;
 }
+
+void* erealloc(void* p, size_t size)
+{
+	if (! (p = realloc(p, size)))
+		die("realloc:");
+	return p;
+}
+
+void* slab_alloc(Slab* s)
+{
+	size_t stride = SLABSTRIDE(s), i;
+	char*  slab;
+	void*  p;
+
+	if (! s->free) {
+		slab          = ecalloc(1, sizeof(SlabAlign) + s->perslab * stride);
+		*(void**)slab = s->slabs;
+		s->slabs      = slab;
+		for (i = s->perslab; i-- > 0;) {
+			p          = slab + sizeof(SlabAlign) + i * stride;
+			*(void**)p = s->free;
+			s->free    = p;
+		}
+	}
+	p       = s->free;
+	s->free = *(void**)p;
+	memset(p, 0, s->size);
+	return p;
+}
+
+void slab_free(Slab* s, void* p)
+{
+	if (! p)
+		return;
+	*(void**)p = s->free;
+	s->free    = p;
+}
+
+void slab_release(Slab* s)
+{
+	void* next;
+
+	for (; s->slabs; s->slabs = next) {
+		next = *(void**)s->slabs;
+		free(s->slabs);
+	}
+	s->free = NULL;
+}
+
+size_t utf8seq(const char* s, size_t len)
+{
+	const unsigned char* u = (const unsigned char*) s;
+	size_t               j, n;
+	unsigned long        c;
+
+	if (! len)
+		return 0;
+	if (u[0] < 0x80)
+		return 1;
+	if (u[0] >= 0xC2 && u[0] <= 0xDF)
+		n = 2, c = u[0] & 0x1F;
+	else if (u[0] >= 0xE0 && u[0] <= 0xEF)
+		n = 3, c = u[0] & 0x0F;
+	else if (u[0] >= 0xF0 && u[0] <= 0xF4)
+		n = 4, c = u[0] & 0x07;
+	else
+		return 0;
+	if (n > len)
+		return 0;
+	for (j = 1; j < n && (u[j] & 0xC0) == 0x80; j++)
+		c = c << 6 | (u[j] & 0x3F);
+	/* continuation bytes, overlong forms, surrogates, beyond U+10FFFF */
+	if (j < n || (n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF))
+			|| (c >= 0xD800 && c <= 0xDFFF))
+		return 0;
+	return n;
+}
+
+size_t utf8trunc(char* s, size_t len)
+{
+	size_t i, n;
+
+	for (i = 0; i < len && (n = utf8seq(s + i, len - i)); i += n)
+		;
+	s[i] = '\0';
+	return i;
+}
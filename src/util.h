@@ -10,7 +10,32 @@
 #define MIN(A, B)        ((A) < (B) ? (A) : (B))
 #define BETWEEN(X, A, B) ((A) <= (X) && (X) <= (B))
 
+/* Fixed size objects carved from blocks of perslab at a time, so frequent
+ * small allocations neither go through malloc nor scatter over the heap.
+ * Freed objects are kept on a free list for the next slab_alloc(). */
+typedef struct {
+	size_t size;
+	size_t perslab;
+	void*  free;
+	void*  slabs; /* chained through their first word */
+} Slab;
+
+#define SLAB(type, perslab) { sizeof(type), (perslab), NULL, NULL }
+
 void  die(const char* fmt, ...);
 void* ecalloc(size_t nmemb, size_t size);
+void* erealloc(void* p, size_t size);
+
+void* slab_alloc(Slab* s); /* zeroed, dies when out of memory */
+void  slab_free(Slab* s, void* p);
+void  slab_release(Slab* s); /* every slab, live objects included */
+
+/* The length of the valid UTF-8 character s starts with, 0 if it does not
+ * start with one within len bytes. */
+size_t utf8seq(const char* s, size_t len);
+
+/* Cuts s, of len bytes, after its longest valid UTF-8 prefix and returns
+ * that prefix's length. s must have room for the terminating NUL. */
+size_t utf8trunc(char* s, size_t len);
 
 #endif /* ifndef UTIL_H */
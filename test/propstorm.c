@@ -0,0 +1,143 @@
+/* cc propstorm.c -o propstorm -lX11 -lXtst
+ *
+ * Presses Mod4-j through XTest and prints how long dwm takes to move the
+ * focus, first on a quiet display and then while a second connection floods
+ * the title of a window. Run it on a tag with another window to focus.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#define PRESSES 50
+#define BURST   200 /* title changes per flush */
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* retitles w as fast as the server takes it, until killed */
+static void storm(Window w) {
+	Display *d;
+	Atom name, utf8;
+	char buf[64];
+	unsigned long n = 0;
+	int i;
+
+	if (!(d = XOpenDisplay(NULL)))
+		exit(1);
+	name = XInternAtom(d, "_NET_WM_NAME", False);
+	utf8 = XInternAtom(d, "UTF8_STRING", False);
+	for (;;) {
+		for (i = 0; i < BURST; i++) {
+			snprintf(buf, sizeof buf, "propstorm %lu%%", n++);
+			XChangeProperty(d, w, name, utf8, 8, PropModeReplace,
+				(unsigned char *)buf, strlen(buf));
+			XStoreName(d, w, buf);
+		}
+		XSync(d, False);
+	}
+}
+
+/* waits for _NET_ACTIVE_WINDOW to change, returns the seconds it took */
+static double waitfocus(Display *d, Atom active, double timeout) {
+	double t0 = now(), left;
+	struct timeval tv;
+	fd_set fds;
+	XEvent e;
+
+	for (;;) {
+		while (XPending(d)) {
+			XNextEvent(d, &e);
+			if (e.type == PropertyNotify && e.xproperty.atom == active)
+				return now() - t0;
+		}
+		if ((left = timeout - (now() - t0)) <= 0)
+			return -1;
+		tv.tv_sec = left;
+		tv.tv_usec = (left - tv.tv_sec) * 1e6;
+		FD_ZERO(&fds);
+		FD_SET(ConnectionNumber(d), &fds);
+		select(ConnectionNumber(d) + 1, &fds, NULL, NULL, &tv);
+	}
+}
+
+static void measure(Display *d, Atom active, const char *what) {
+	KeyCode mod = XKeysymToKeycode(d, XK_Super_L), j = XKeysymToKeycode(d, XK_j);
+	double t[PRESSES];
+	int i, n = 0, lost = 0;
+
+	for (i = 0; i < PRESSES; i++) {
+		XTestFakeKeyEvent(d, mod, True, CurrentTime);
+		XTestFakeKeyEvent(d, j, True, CurrentTime);
+		XTestFakeKeyEvent(d, j, False, CurrentTime);
+		XTestFakeKeyEvent(d, mod, False, CurrentTime);
+		XFlush(d);
+		if ((t[n] = waitfocus(d, active, 2.0)) < 0)
+			lost++;
+		else
+			n++;
+		usleep(20000);
+	}
+	qsort(t, n, sizeof t[0], cmp);
+	if (n)
+		printf("%-6s %d presses, min %.2f ms, median %.2f ms, max %.2f ms, %d lost\n",
+			what, PRESSES, t[0] * 1e3, t[n / 2] * 1e3, t[n - 1] * 1e3, lost);
+	else
+		printf("%-6s no focus change seen, is there a window to focus?\n", what);
+}
+
+int main(void) {
+	Display *d;
+	Window r, w;
+	Atom active;
+	pid_t pid;
+	int ev, err, maj, min;
+
+	if (!(d = XOpenDisplay(NULL)))
+		exit(1);
+	if (!XTestQueryExtension(d, &ev, &err, &maj, &min)) {
+		fprintf(stderr, "propstorm: no XTest extension\n");
+		exit(1);
+	}
+	r = DefaultRootWindow(d);
+	active = XInternAtom(d, "_NET_ACTIVE_WINDOW", False);
+
+	w = XCreateSimpleWindow(d, r, 0, 0, 200, 100, 0, 0, 0);
+	XStoreName(d, w, "propstorm");
+	XMapWindow(d, w);
+	XSelectInput(d, r, PropertyChangeMask);
+	XSync(d, False);
+	sleep(1);
+
+	measure(d, active, "quiet");
+	if ((pid = fork()) < 0)
+		exit(1);
+	if (!pid)
+		storm(w);
+	sleep(1);
+	measure(d, active, "storm");
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	XCloseDisplay(d);
+	exit(0);
+}
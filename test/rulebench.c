@@ -0,0 +1,106 @@
+/* cc -O2 -I../src rulebench.c ../src/rules.c ../src/util.c -o rulebench */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rules.h"
+
+#define NRULES 1000
+#define NWINS  10000
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+static char *fmt(const char *f, unsigned int n) {
+	char buf[64];
+
+	snprintf(buf, sizeof buf, f, n);
+	return strdup(buf);
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+	static const char *pats[NRULES * RuleLast];
+	static RuleRec recs[NRULES];
+	static char *wins[NWINS][RuleLast];
+	static unsigned int linear[NRULES];
+	RuleIndex *ri;
+	const char *p;
+	double t0, tlin, tidx;
+	unsigned int i, j, k, n, nlin, total = 0;
+
+	/* generated per-project rules: mostly class, some instance or title
+	 * fragments, a few combined and a few catch-all rules */
+	for (i = 0; i < NRULES; i++) {
+		switch (rnd(10)) {
+		case 0: case 1: case 2: case 3: case 4:
+			pats[i * RuleLast + RuleClass] = fmt("Proj%03u", rnd(800));
+			break;
+		case 5: case 6:
+			pats[i * RuleLast + RuleInstance] = fmt("inst%03u", rnd(400));
+			break;
+		case 7: case 8:
+			pats[i * RuleLast + RuleTitle] = fmt(" - proj%03u", rnd(800));
+			break;
+		default:
+			pats[i * RuleLast + RuleClass] = fmt("Proj%02u", rnd(80));
+			pats[i * RuleLast + RuleTitle] = fmt("file%u", rnd(50));
+			break;
+		}
+	}
+	for (i = 0; i < NWINS; i++) {
+		wins[i][RuleClass] = fmt("Proj%03u", rnd(1000));
+		wins[i][RuleInstance] = fmt("inst%03u", rnd(600));
+		wins[i][RuleTitle] = fmt("file%u.c - proj%03u - Editor", rnd(100) * 1000 + rnd(1000));
+	}
+
+	t0 = now();
+	ri = ri_create(pats, recs, NRULES);
+	printf("compile: %.3f ms\n", (now() - t0) * 1e3);
+
+	tlin = tidx = 0;
+	for (i = 0; i < NWINS; i++) {
+		t0 = now();
+		for (j = 0, nlin = 0; j < NRULES; j++) {
+			for (k = 0; k < RuleLast; k++)
+				if ((p = pats[j * RuleLast + k]) && !strstr(wins[i][k], p))
+					break;
+			if (k == RuleLast)
+				linear[nlin++] = j;
+		}
+		tlin += now() - t0;
+
+		t0 = now();
+		n = ri_match(ri, (const char **)wins[i]);
+		tidx += now() - t0;
+
+		if (n != nlin)
+			goto mismatch;
+		for (j = 0, k = -1; j < n; j++)
+			if ((k = ri_next(ri, k)) != linear[j])
+				goto mismatch;
+		total += n;
+	}
+	printf("%d windows x %d rules, %u matches\n", NWINS, NRULES, total);
+	printf("strstr: %.3f ms, %.3f us/window\n", tlin * 1e3, tlin * 1e6 / NWINS);
+	printf("index:  %.3f ms, %.3f us/window\n", tidx * 1e3, tidx * 1e6 / NWINS);
+	ri_free(ri);
+	return 0;
+
+mismatch:
+	fprintf(stderr, "rulebench: window %u '%s' '%s' '%s' matched differently\n",
+		i, wins[i][RuleClass], wins[i][RuleInstance], wins[i][RuleTitle]);
+	return 1;
+}